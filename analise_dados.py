@@ -1,20 +1,35 @@
 import pandas as pd
 import matplotlib.pyplot as plt
+import glob
 import os
+import re
 
 FILE_NAME = 'datalog.csv'
 
+# Se o cartão foi trocado durante a gravação, a sessão continua em
+# segmentos: datalog.csv, datalog_1.csv, datalog_2.csv...
+def segmentos(file_path):
+    base, ext = os.path.splitext(file_path)
+    padrao = re.compile(r'_(\d+)' + re.escape(ext) + '$')
+    extras = [p for p in glob.glob(f"{glob.escape(base)}_*{ext}") if padrao.search(p)]
+    return [file_path] + sorted(extras, key=lambda p: int(padrao.search(p).group(1)))
+
 def plotar_dados(file_path):
     if not os.path.exists(file_path):
         print(f"Erro: Arquivo '{file_path}' não encontrado!")
         return
 
-    print(f"Lendo dados de '{file_path}'...")
-    try:
-        df = pd.read_csv(file_path)
-    except Exception as e:
-        print(f"Erro ao ler o arquivo CSV: {e}")
-        return
+    partes = []
+    for caminho in segmentos(file_path):
+        print(f"Lendo dados de '{caminho}'...")
+        try:
+            partes.append(pd.read_csv(caminho))
+        except Exception as e:
+            print(f"Erro ao ler o arquivo CSV: {e}")
+            return
+    # Um segmento recomeça da última amostra sincronizada: pode repetir algumas
+    df = pd.concat(partes, ignore_index=True)
+    df = df.drop_duplicates('numero_amostra', keep='last').sort_values('numero_amostra')
     df['tempo'] = pd.to_datetime(df['data_hora'], format='%d/%m/%Y-%H:%M:%S')
 
 
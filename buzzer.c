@@ -0,0 +1,90 @@
+#include "pico/stdlib.h"
+#include "hardware/pwm.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "buzzer.h"
+
+static uint buzzer_pin, buzzer_slice;
+static uint16_t buzzer_top;             // Wrap do PWM na frequência atual
+static BuzzerPattern current;
+static uint8_t remaining;               // Bipes que faltam, contando o atual
+static bool sounding;
+static volatile uint32_t generation;    // Invalida alarmes de sequências antigas
+static volatile alarm_id_t alarm;       // 0: nada tocando
+
+static void buzzer_set_frequency(uint32_t freq_hz)
+{
+    // Menor divisor que deixa o wrap em 16 bits: mais resolução no duty
+    uint32_t clk = clock_get_hz(clk_sys);
+    float div = clk / (freq_hz * 65536.0f);
+    if (div < 1.0f)
+        div = 1.0f;
+    buzzer_top = clk / (div * freq_hz) - 1;
+    pwm_set_clkdiv(buzzer_slice, div);
+    pwm_set_wrap(buzzer_slice, buzzer_top);
+}
+
+// Interrupção do alarme: alterna entre tom (duty 50%) e silêncio e agenda
+// a próxima troca a partir do instante previsto para esta (retorno negativo)
+static int64_t buzzer_alarm(alarm_id_t id, void *user_data)
+{
+    if ((uint32_t)(uintptr_t)user_data != generation)
+        return 0;
+    if (sounding)
+    {
+        pwm_set_gpio_level(buzzer_pin, 0);
+        sounding = false;
+        if (--remaining == 0)
+        {
+            alarm = 0;
+            return 0;
+        }
+        return current.off_ms ? -(int64_t)current.off_ms * 1000 : -1;
+    }
+    pwm_set_gpio_level(buzzer_pin, buzzer_top / 2);
+    sounding = true;
+    return -(int64_t)current.on_ms * 1000;
+}
+
+void buzzer_init(uint pin)
+{
+    buzzer_pin = pin;
+    buzzer_slice = pwm_gpio_to_slice_num(pin);
+    gpio_set_function(pin, GPIO_FUNC_PWM);
+    pwm_config config = pwm_get_default_config();
+    pwm_init(buzzer_slice, &config, true);
+    // Iniciar o PWM no nível baixo
+    pwm_set_gpio_level(pin, 0);
+}
+
+void buzzer_play(const BuzzerPattern *pattern)
+{
+    if (!pattern->count || !pattern->on_ms || !pattern->freq_hz)
+        return;
+    alarm_id_t old = alarm;
+    if (old > 0)
+        cancel_alarm(old);
+
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t gen = ++generation;
+    current = *pattern;
+    remaining = pattern->count;
+    buzzer_set_frequency(pattern->freq_hz);
+    pwm_set_gpio_level(buzzer_pin, buzzer_top / 2);
+    sounding = true;
+    restore_interrupts(irq);
+
+    alarm = add_alarm_in_ms(pattern->on_ms, buzzer_alarm, (void *)(uintptr_t)gen, true);
+    if (alarm <= 0)
+    {
+        // Sem alarme livre: não deixa o tom ligado
+        pwm_set_gpio_level(buzzer_pin, 0);
+        sounding = false;
+        alarm = 0;
+    }
+}
+
+bool buzzer_busy(void)
+{
+    return alarm != 0;
+}
@@ -0,0 +1,23 @@
+#ifndef BUZZER_H
+#define BUZZER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "pico/types.h"
+
+// Sequência de bipes: count bipes de on_ms, separados por off_ms
+typedef struct
+{
+    uint8_t count;
+    uint16_t on_ms;
+    uint16_t off_ms;
+    uint16_t freq_hz;
+} BuzzerPattern;
+
+void buzzer_init(uint pin);
+// Não bloqueia: o PWM gera o tom e um alarme de hardware liga e desliga.
+// Uma sequência nova substitui a que estiver tocando.
+void buzzer_play(const BuzzerPattern *pattern);
+bool buzzer_busy(void);
+
+#endif
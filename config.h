@@ -7,7 +7,11 @@
 #include "hw_config.h"
 #include "rtc.h"
 #include "sd_card.h"
+#include "sd_trace.h"
+#include "buzzer.h"
+#include "status_led.h"
 #include <string.h>
+#include <math.h>
 
 #define LED_PIN_RED 13
 #define LED_PIN_GREEN 11
@@ -42,6 +46,9 @@ typedef struct
 //máximo de amostras na RAM
 #define MAX_SAMPLES 3000
 
+// Intervalo entre amostras da captura
+#define SAMPLE_PERIOD_MS 100
+
 enum MODE
 {
     WAITING,
@@ -49,51 +56,238 @@ enum MODE
     READY,
     CAPTURING,
     ACESSING,
+    NOCARD, // Cartão removido durante a gravação: aguarda a reinserção
     ERROR
 };
 
+// Cor e efeito do LED RGB em cada modo
+typedef struct
+{
+    uint8_t red, green, blue;
+    LedEffect effect;
+    uint16_t period_ms;
+} ModeLed;
+
+static const ModeLed mode_leds[] = {
+    [WAITING] = {255, 255, 255, LED_STEADY, 0},  // Branco
+    [SDMOUNT] = {255, 255, 0, LED_BREATHE, 1500}, // Amarelo respirando
+    [READY] = {0, 255, 0, LED_STEADY, 0},         // Verde
+    [CAPTURING] = {255, 0, 0, LED_STEADY, 0},     // Vermelho
+    [ACESSING] = {0, 0, 255, LED_BLINK, 500},     // Azul piscando
+    [NOCARD] = {255, 255, 0, LED_BLINK, 500},     // Amarelo piscando
+    [ERROR] = {255, 0, 255, LED_BLINK, 500},      // Roxo piscando
+};
+
 // Mensagem comunicação entre tarefas
 typedef struct
 {
     enum MODE new_mode;
     uint32_t sample_count; 
 } DisplayMessage;
-static char filename[20] = "datalog.csv";
 
-void gpio_irq_handler(uint gpio, uint32_t events);
+// Eventos que acordam a vControlTask (um bit cada em xControlEvents)
+typedef enum
+{
+    EV_BUTTON_A,
+    EV_BUTTON_B,
+    EV_MOUNT_DONE,  // vMountTask terminou (resultado em mount_ok)
+    EV_CARD_CHANGE, // vCardMonitorTask viu um cartão sair ou voltar
+    EV_BUFFER_FULL, // vCaptureTask encheu o buffer e parou
+    EV_SAVE_DONE,   // vSaveTask terminou (resultado em save_result)
+    EV_COUNT
+} ControlEvent;
+
+#define EV_ALL_BITS ((1u << EV_COUNT) - 1)
+
+static const char *const event_names[EV_COUNT] = {
+    "botao A", "botao B", "montagem", "cartao", "buffer cheio", "gravacao"};
+
+// Latência entre sinalizar um evento e a vControlTask tratá-lo
+typedef struct
+{
+    uint32_t count;
+    uint32_t total_us;
+    uint32_t max_us;
+} EventLatency;
+
+static void event_latency_add(EventLatency *l, uint32_t us)
+{
+    l->count++;
+    l->total_us += us;
+    if (us > l->max_us)
+        l->max_us = us;
+}
+
+static void print_event_latency(const EventLatency *l)
+{
+    printf("Latencia evento -> acao (us):\n");
+    for (int i = 0; i < EV_COUNT; ++i)
+        if (l[i].count)
+            printf("  %-12s %5lu eventos, media %6lu, max %6lu\n", event_names[i],
+                   l[i].count, l[i].total_us / l[i].count, l[i].max_us);
+}
 
-// Função para inicializar o buzzer
-void pwm_init_buzzer(uint pin) {
-    // Configurar o pino como saída de PWM
-    gpio_set_function(pin, GPIO_FUNC_PWM);
+// Resultado da gravação (vSaveTask)
+typedef enum
+{
+    SAVE_OK,
+    SAVE_LOST, // Um cartão saiu: os dados seguem na RAM
+    SAVE_ERROR
+} SaveResult;
 
-    // Obter o slice do PWM associado ao pino
-    uint slice_num = pwm_gpio_to_slice_num(pin);
+// Progresso da montagem em segundo plano (vMountTask), lido pelo display
+typedef struct
+{
+    volatile bool busy;
+    volatile uint8_t progress;  // 0 a 100
+    const char *volatile stage; // Etapa atual
+    const char *volatile card;  // Cartão da etapa atual
+    volatile uint32_t free_mb;  // Espaço livre no cartão 0
+} MountStatus;
 
-    // Configurar o PWM com frequência desejada
-    pwm_config config = pwm_get_default_config();
-    pwm_config_set_clkdiv(&config, clock_get_hz(clk_sys) / (BUZZER_FREQUENCY * 4096)); // Divisor de clock
-    pwm_init(slice_num, &config, true);
+static char filename[20] = "datalog.csv";
 
-    // Iniciar o PWM no nível baixo
-    pwm_set_gpio_level(pin, 0);
+// Com dois cartões montados: LOG_STRIPE (faixas, mais vazão; una as partes
+// com unir_faixas.py) ou LOG_MIRROR (o mesmo arquivo nos dois cartões)
+#define LOG_DUAL_MODE LOG_STRIPE
+
+// A gravação faz um f_sync a cada LOG_SYNC_SAMPLES amostras. Se o cartão
+// sair, o próximo segmento recomeça da última amostra sincronizada.
+#define LOG_SYNC_SAMPLES 500
+
+// Trace dos comandos do cartão durante a última gravação, para o
+// histograma_sd.py (com SD_TRACE_ENABLED, veja o CMakeLists.txt)
+#define SD_TRACE_FILE "0:sdtrace.bin"
+
+// Medição da disputa pelos locks do FatFs: com LOCK_BENCH_SECONDS > 0
+// (por exemplo, LOCK_BENCH_SECONDS=10 no target_compile_definitions do
+// CMakeLists.txt), cada montagem roda o ff_lock_contention_bench com
+// LOCK_BENCH_WRITERS tarefas no cartão 0 e imprime o resultado
+#ifndef LOCK_BENCH_SECONDS
+#define LOCK_BENCH_SECONDS 0
+#endif
+#ifndef LOCK_BENCH_WRITERS
+#define LOCK_BENCH_WRITERS 2
+#endif
+
+// Intervalo de verificação da presença dos cartões (vCardMonitorTask)
+#define CARD_MONITOR_PERIOD_MS 500
+
+// Nome do arquivo de um segmento: datalog.csv, datalog_1.csv, datalog_2.csv...
+static void segment_name(char *out, size_t size, uint32_t segment)
+{
+    if (!segment)
+    {
+        snprintf(out, size, "%s", filename);
+        return;
+    }
+    const char *ext = strrchr(filename, '.');
+    int base_len = ext ? ext - filename : (int)strlen(filename);
+    snprintf(out, size, "%.*s_%lu%s", base_len, filename, segment, ext ? ext : "");
 }
 
-// Função para emitir um beep com duração especificada
-void beep(uint pin, uint duration_ms) {
-    // Obter o slice do PWM associado ao pino
-    uint slice_num = pwm_gpio_to_slice_num(pin);
+// Osciloscópio da tela de captura: o traço rola para a esquerda com um
+// ponto novo por coluna. O botão B troca o sinal durante a captura.
+typedef enum
+{
+    SCOPE_ACCEL_X,
+    SCOPE_ACCEL_Y,
+    SCOPE_ACCEL_Z,
+    SCOPE_ACCEL_MAG, // Módulo da aceleração
+    SCOPE_SIGNALS
+} ScopeSignal;
+
+// Cada ponto do traço é a média de SCOPE_DECIMATION amostras
+#define SCOPE_DECIMATION 1
+// Pontos entre a captura e o display (potência de 2)
+#define SCOPE_TAP_SIZE 64
+// Taxa máxima de quadros do display: mensagens que chegam mais rápido
+// que isso são agrupadas e só o estado mais recente é desenhado
+#define DISPLAY_MAX_FPS 25
+#define DISPLAY_FRAME_MS (1000 / DISPLAY_MAX_FPS)
+
+// Intervalo entre quadros do osciloscópio
+#define SCOPE_FRAME_MS DISPLAY_FRAME_MS
+
+// Atualização da tela de diagnóstico (live_stats.h)
+#define STATS_REFRESH_MS 500
+
+// Derivação da captura para o display: a vCaptureTask escreve (head) e a
+// vDisplayTask lê (tail). Se o display atrasar, os pontos novos são
+// descartados; a captura nunca espera.
+typedef struct
+{
+    float points[SCOPE_TAP_SIZE];
+    volatile uint32_t head, tail;
+    volatile ScopeSignal signal;
+    ScopeSignal sum_signal; // Sinal da decimação em andamento
+    float sum;
+    uint32_t count;
+} ScopeTap;
+
+static ScopeTap scope_tap = {.signal = SCOPE_ACCEL_MAG, .sum_signal = SCOPE_ACCEL_MAG};
 
-    // Configurar o duty cycle para 50% (ativo)
-    pwm_set_gpio_level(pin, 2048);
+static float scope_value(const ImuSample *s, ScopeSignal signal)
+{
+    switch (signal)
+    {
+    case SCOPE_ACCEL_X:
+        return s->accel_x;
+    case SCOPE_ACCEL_Y:
+        return s->accel_y;
+    case SCOPE_ACCEL_Z:
+        return s->accel_z;
+    default:
+        return sqrtf(s->accel_x * s->accel_x + s->accel_y * s->accel_y + s->accel_z * s->accel_z);
+    }
+}
+
+// Chamada pela captura a cada amostra
+static void scope_tap_push(const ImuSample *s)
+{
+    ScopeSignal signal = scope_tap.signal;
+    if (signal != scope_tap.sum_signal)
+    {
+        scope_tap.sum_signal = signal;
+        scope_tap.sum = 0;
+        scope_tap.count = 0;
+    }
+    scope_tap.sum += scope_value(s, signal);
+    if (++scope_tap.count < SCOPE_DECIMATION)
+        return;
+    float value = scope_tap.sum / scope_tap.count;
+    scope_tap.sum = 0;
+    scope_tap.count = 0;
+    uint32_t head = scope_tap.head;
+    if (head - scope_tap.tail >= SCOPE_TAP_SIZE)
+        return;
+    scope_tap.points[head % SCOPE_TAP_SIZE] = value;
+    scope_tap.head = head + 1;
+}
 
-    // Temporização
-    sleep_ms(duration_ms);
+static bool scope_tap_pop(float *value)
+{
+    uint32_t tail = scope_tap.tail;
+    if (tail == scope_tap.head)
+        return false;
+    *value = scope_tap.points[tail % SCOPE_TAP_SIZE];
+    scope_tap.tail = tail + 1;
+    return true;
+}
 
-    // Desativar o sinal PWM (duty cycle 0)
-    pwm_set_gpio_level(pin, 0);
+// Troca o sinal; a captura recomeça a decimação no próximo ponto
+static void scope_next_signal(void)
+{
+    scope_tap.signal = (scope_tap.signal + 1) % SCOPE_SIGNALS;
 }
 
+void gpio_irq_handler(uint gpio, uint32_t events);
+
+// Sinais sonoros (buzzer.h): um bipe ao iniciar a captura, montar e
+// desmontar o cartão; bipe duplo ao parar a captura ou a gravação
+static const BuzzerPattern beep_single = {.count = 1, .on_ms = 100, .off_ms = 0, .freq_hz = BUZZER_FREQUENCY};
+static const BuzzerPattern beep_double = {.count = 2, .on_ms = 100, .off_ms = 80, .freq_hz = BUZZER_FREQUENCY};
+
 //Encontra uma estrutura de cartão SD pelo seu nome
 static sd_card_t *sd_get_by_name(const char *const name)
 {
@@ -186,9 +380,24 @@ void capture_imu_data_and_save(const char *filename, int num_samples)
     printf("Dados salvos com sucesso em %s\n", filename);
 }
 
-bool mount_sd_card() {
-    // Pega o caminho do primeiro cartão
-    const char *drive_path = sd_get_by_num(0)->pcName;
+// Cartões montados pelo usuário (bit i = cartão i). O monitor de cartões
+// remonta automaticamente os que forem reinseridos.
+static uint32_t cards_wanted;
+
+static void mount_progress(MountStatus *st, const char *stage, const char *card,
+                           uint8_t progress) {
+    if (!st)
+        return;
+    st->stage = stage;
+    st->card = card;
+    st->progress = progress;
+}
+
+// Monta um cartão pelo número. Não imprime nada em caso de sucesso.
+// O progresso vai de p0 a p0 + span em st (que pode ser NULL).
+static bool mount_sd_card_num(size_t num, MountStatus *st, uint8_t p0, uint8_t span) {
+    sd_card_t *pSD = sd_get_by_num(num);
+    const char *drive_path = pSD->pcName;
     if (!drive_path) {
         printf("ERRO: Nao foi possivel encontrar o caminho do SD card.\n");
         return false;
@@ -201,28 +410,111 @@ bool mount_sd_card() {
         return false;
     }
 
+    // Inicializa o cartão (CMD0/ACMD41...): a parte demorada, que leva
+    // segundos sem cartão no soquete
+    mount_progress(st, "Iniciando", drive_path, p0);
+    if (disk_initialize(num) & STA_NOINIT) {
+        printf("ERRO: Cartao %s nao respondeu.\n", drive_path);
+        return false;
+    }
+
     // Tenta montar o drive
+    mount_progress(st, "Montando", drive_path, p0 + span / 2);
     FRESULT fr = f_mount(p_fs, drive_path, 1);
     if (fr != FR_OK) {
-        printf("ERRO de f_mount: %s (%d)\n", FRESULT_str(fr), fr);
+        printf("ERRO de f_mount em %s: %s (%d)\n", drive_path, FRESULT_str(fr), fr);
         return false;
     }
 
     // Atualiza o status no driver do SD
-    sd_card_t *pSD = sd_get_by_name(drive_path);
     pSD->mounted = true;
-    printf("Cartao SD montado com sucesso.\n");
     return true;
 }
 
-void unmount_sd_card() {
+// Monta o cartão 0 (obrigatório) e os demais, se presentes: com dois
+// cartões o log é gravado em faixas (log_storage.c). Depois calcula o espaço
+// livre, que no FAT32 sem FSInfo válido varre a FAT inteira. Roda na
+// vMountTask; st recebe o progresso para o display.
+bool mount_sd_card(MountStatus *st) {
+    uint8_t span = 90 / sd_get_num();
+    if (!mount_sd_card_num(0, st, 0, span))
+        return false;
+    cards_wanted = 1;
+    size_t mounted = 1;
+    for (size_t i = 1; i < sd_get_num(); ++i) {
+        // Sem cartão, o disk_initialize insiste por segundos no CMD0/ACMD41:
+        // antes, um CMD0 só (sd_test_com) confere se há alguém no soquete
+        sd_card_t *pSD = sd_get_by_num(i);
+        if ((pSD->use_card_detect && !sd_card_detect(pSD)) || !pSD->sd_test_com(pSD)) {
+            printf("Cartao %s ausente.\n", pSD->pcName);
+            break;
+        }
+        if (!mount_sd_card_num(i, st, i * span, span))
+            break;
+        cards_wanted |= 1u << i;
+        mounted++;
+    }
+    printf("Cartao SD montado com sucesso (%u cartao(oes)).\n", (unsigned)mounted);
+
     const char *drive_path = sd_get_by_num(0)->pcName;
-    f_mount(NULL, drive_path, 1);
-    
-    sd_card_t *pSD = sd_get_by_name(drive_path);
-    if (pSD) {
+    mount_progress(st, "Espaco livre", drive_path, 90);
+    DWORD free_clusters;
+    FATFS *p_fs;
+    if (FR_OK == f_getfree(drive_path, &free_clusters, &p_fs)) {
+        // Setores de 512 bytes: 2048 por MB
+        uint32_t free_mb = (uint64_t)free_clusters * p_fs->csize / 2048;
+        if (st)
+            st->free_mb = free_mb;
+        printf("Espaco livre em %s: %lu MB\n", drive_path, free_mb);
+    }
+    mount_progress(st, "Pronto", drive_path, 100);
+    return true;
+}
+
+void unmount_sd_card() {
+    cards_wanted = 0;
+    for (size_t i = 0; i < sd_get_num(); ++i) {
+        sd_card_t *pSD = sd_get_by_num(i);
+        if (!pSD->mounted)
+            continue;
+        f_mount(NULL, pSD->pcName, 1);
         pSD->mounted = false;
-        pSD->m_Status |= STA_NOINIT; 
+        pSD->m_Status |= STA_NOINIT;
     }
     printf("Cartao SD desmontado.\n");
-}
\ No newline at end of file
+}
+
+// Máscara dos cartões montados
+static uint32_t mounted_sd_cards(void) {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < sd_get_num(); ++i)
+        if (sd_get_by_num(i)->mounted)
+            mask |= 1u << i;
+    return mask;
+}
+
+// Confere se os cartões montados continuam no soquete e remonta os que
+// voltaram. Usa o pino de detecção, se configurado, ou um CMD13/CMD0.
+// Retorna true se falta algum cartão montado pelo usuário.
+static bool check_sd_cards() {
+    bool missing = false;
+    for (size_t i = 0; i < sd_get_num(); ++i) {
+        if (!(cards_wanted & (1u << i)))
+            continue;
+        sd_card_t *pSD = sd_get_by_num(i);
+        bool present = pSD->use_card_detect ? sd_card_detect(pSD) : true;
+        if (present)
+            present = pSD->sd_test_com(pSD);
+        if (pSD->mounted && !present) {
+            // O FATFS fica registrado; a remontagem relê o volume
+            pSD->mounted = false;
+            pSD->m_Status |= STA_NOINIT;
+            printf("Cartao %s removido.\n", pSD->pcName);
+        } else if (!pSD->mounted && present && mount_sd_card_num(i, NULL, 0, 0)) {
+            printf("Cartao %s remontado.\n", pSD->pcName);
+        }
+        if (!pSD->mounted)
+            missing = true;
+    }
+    return missing;
+}
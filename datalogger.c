@@ -10,6 +10,7 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "semphr.h"
+#include "event_groups.h"
 #include "hardware/rtc.h"
 
 #include "ff.h"
@@ -17,9 +18,52 @@
 #include "f_util.h"
 #include "hw_config.h"
 #include "sd_card.h"
+#include "log_storage.h"
+#include "live_stats.h"
+
+// Eventos da vControlTask (ControlEvent): ela dorme até um deles chegar
+EventGroupHandle_t xControlEvents;
+// Posse dos cartões: montagem, desmontagem, gravação e o monitor de cartões
+SemaphoreHandle_t xCardMutex;
+// Montagem em segundo plano: pedido, resultado e progresso
+SemaphoreHandle_t xMountRequestSemaphore;
+volatile bool mount_ok;
+MountStatus mount_status = {.stage = "", .card = ""};
+// Gravação em segundo plano (vSaveTask): pedido e resultado
+SemaphoreHandle_t xSaveRequestSemaphore;
+volatile SaveResult save_result;
+QueueHandle_t xDisplayQueue;
+// Fim do envio de um quadro por DMA (interrupção do I2C do display)
+SemaphoreHandle_t xDisplayDoneSemaphore;
+// Contadores da tela de diagnóstico e a tela escolhida com o botão B
+LiveStats live_stats;
+volatile bool display_stats;
+TaskHandle_t xCaptureTaskHandle;
+
+// Buffer da captura. A vCaptureTask só escreve com capture_running; a
+// vSaveTask só lê fora da captura; a vControlTask alterna entre as duas.
+static ImuSample data_buffer[MAX_SAMPLES];
+static volatile uint32_t samples_in_buffer;
+static volatile bool capture_running;
+static uint32_t samples_saved; // Amostras já sincronizadas no cartão
+static uint32_t segment;       // Segmento do arquivo (novo a cada reinserção)
+
+// Instante em que cada evento foi sinalizado e a latência até a
+// vControlTask tratá-lo
+static volatile uint32_t event_time_us[EV_COUNT];
+static EventLatency event_latency[EV_COUNT];
+
+static void signal_event(ControlEvent ev)
+{
+    event_time_us[ev] = time_us_32();
+    xEventGroupSetBits(xControlEvents, 1u << ev);
+}
 
-SemaphoreHandle_t xBuzzerSemaphore, xButtonASemaphore, xButtonBSemaphore;
-QueueHandle_t xDisplayQueue, xLedQueue;
+static void signal_event_from_isr(ControlEvent ev, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    event_time_us[ev] = time_us_32();
+    xEventGroupSetBitsFromISR(xControlEvents, 1u << ev, pxHigherPriorityTaskWoken);
+}
 
 void gpio_irq_handler(uint gpio, uint32_t events)
 {
@@ -31,12 +75,12 @@ void gpio_irq_handler(uint gpio, uint32_t events)
     if (gpio == BUTTON_A && (now - last_time_button_A > DEBOUNCE_TIME))
     {
         last_time_button_A = now;
-        xSemaphoreGiveFromISR(xButtonASemaphore, &xHigherPriorityTaskWoken);
+        signal_event_from_isr(EV_BUTTON_A, &xHigherPriorityTaskWoken);
     }
     if (gpio == BUTTON_B && (now - last_time_button_B > DEBOUNCE_TIME))
     {
         last_time_button_B = now;
-        xSemaphoreGiveFromISR(xButtonBSemaphore, &xHigherPriorityTaskWoken);
+        signal_event_from_isr(EV_BUTTON_B, &xHigherPriorityTaskWoken);
     }
     if (gpio == BUTTON_J)
     {
@@ -45,53 +89,198 @@ void gpio_irq_handler(uint gpio, uint32_t events)
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
+// Salva as amostras da RAM ainda não sincronizadas no cartão
+static SaveResult save_samples(void)
+{
+    char name[32];
+    segment_name(name, sizeof(name), segment);
+
+    // O monitor de cartões não mexe nos cartões durante a gravação
+    xSemaphoreTake(xCardMutex, portMAX_DELAY);
+    // Com dois cartões montados o log é gravado em faixas ou espelhado
+    sd_trace_clear();
+    bool ok = log_storage_open(name, LOG_DUAL_MODE);
+    if (ok)
+    {
+        // Escreve o cabeçalho no arquivo
+        const char *header = "numero_amostra,accel_x,accel_y,accel_z,giro_x,giro_y,giro_z,data_hora\n";
+        log_storage_write(header, strlen(header));
+        uint32_t bytes_total = strlen(header);
+        // Último ponto de sincronização: amostra e bytes até ela
+        uint32_t checkpoint_sample = samples_saved, checkpoint_bytes = 0;
+
+        char buffer[150];
+        // Percorre o buffer da RAM e escreve cada amostra ainda não salva
+        for (uint32_t i = samples_saved; i < samples_in_buffer; i++)
+        {
+            ImuSample *s = &data_buffer[i];
+            int len = snprintf(buffer, sizeof(buffer),
+                               "%lu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%02d/%02d/%04d-%02d:%02d:%02d\n",
+                               s->sample_num, s->accel_x, s->accel_y, s->accel_z,
+                               s->gyro_x, s->gyro_y, s->gyro_z,
+                               s->timestamp.day, s->timestamp.month, s->timestamp.year,
+                               s->timestamp.hour, s->timestamp.min, s->timestamp.sec);
+
+            if (!log_storage_write(buffer, len))
+            {
+                ok = false;
+                break;
+            }
+            bytes_total += len;
+            // Envia uma atualização para o display a cada 100 amostras salvas
+            if (i > 0 && i % 100 == 0)
+            {
+                DisplayMessage prog_msg = {.new_mode = ACESSING, .sample_count = i};
+                xQueueOverwrite(xDisplayQueue, &prog_msg);
+            }
+            // Sincroniza de tempos em tempos para saber até onde os
+            // dados estão garantidos no cartão
+            if ((i + 1) % LOG_SYNC_SAMPLES == 0)
+            {
+                uint32_t durable;
+                if (!log_storage_sync(&durable))
+                {
+                    ok = false;
+                    break;
+                }
+                // No modo faixas a faixa incompleta ainda está na RAM
+                if (durable >= bytes_total)
+                    samples_saved = i + 1;
+                else if (durable >= checkpoint_bytes)
+                    samples_saved = checkpoint_sample;
+                checkpoint_sample = i + 1;
+                checkpoint_bytes = bytes_total;
+            }
+        }
+        // Garante que todos os dados foram escritos e fecha o(s) arquivo(s)
+        if (!log_storage_close())
+            ok = false;
+        if (ok)
+            samples_saved = samples_in_buffer;
+        log_storage_print_stats();
+        for (size_t i = 0; i < sd_get_num(); ++i)
+            if (sd_get_by_num(i)->mounted)
+                sd_card_stats_print(sd_get_by_num(i));
+        for (size_t i = 0; i < spi_get_num(); ++i)
+            spi_stats_print(spi_get_by_num(i));
+#if SD_TRACE_ENABLED
+        if (ok)
+            sd_trace_save(SD_TRACE_FILE);
+#endif
+    }
+    // Se um cartão saiu, os dados continuam na RAM: aguarda a
+    // reinserção e continua num novo segmento
+    bool lost = !ok && check_sd_cards();
+    xSemaphoreGive(xCardMutex);
+
+    if (ok)
+        return SAVE_OK;
+    return lost ? SAVE_LOST : SAVE_ERROR;
+}
+
 void vControlTask(void *pvParameters)
 {
     // Variáveis locais para controlar o estado
     enum MODE current_mode = WAITING;
     bool is_mounted = false;
-    FIL file;
-    static ImuSample data_buffer[MAX_SAMPLES];
-    uint32_t samples_in_buffer = 0;
+    bool saving = false;          // vSaveTask gravando
+    bool stop_after_save = false; // Botão A durante a gravação
 
     // Função interna para atualizar o estado e notificar outras tarefas
     void update_system_state(enum MODE new_mode)
     {
         current_mode = new_mode;
         DisplayMessage msg = {.new_mode = current_mode, .sample_count = samples_in_buffer};
-        // Envia a mensagem para a fila do Display e do LED
-        xQueueSend(xDisplayQueue, &msg, 0);
-        xQueueSend(xLedQueue, &msg, 0);
+        // O display só precisa do estado mais recente
+        xQueueOverwrite(xDisplayQueue, &msg);
+        // O LED só muda de cor/efeito; o PWM cuida do resto
+        const ModeLed *led = &mode_leds[new_mode];
+        status_led_set(led->red, led->green, led->blue, led->effect, led->period_ms);
+    };
+
+    // Pede a montagem à vMountTask; a interface e a captura seguem rodando
+    void start_mount(void)
+    {
+        if (is_mounted || mount_status.busy)
+            return;
+        mount_status.busy = true;
+        mount_status.progress = 0;
+        mount_status.stage = "Aguardando";
+        mount_status.card = "";
+        xSemaphoreGive(xMountRequestSemaphore);
+    };
+
+    // No modo ACESSING: pede à vSaveTask a gravação do que falta. A captura
+    // pode ter terminado antes de o cartão ficar pronto: então espera a
+    // montagem; se ela falhou, aguarda um cartão (botão B tenta de novo).
+    void start_save(void)
+    {
+        if (saving)
+            return;
+        if (!is_mounted)
+        {
+            if (!mount_status.busy)
+                update_system_state(NOCARD);
+            return;
+        }
+        if (samples_saved < samples_in_buffer)
+        {
+            saving = true;
+            xSemaphoreGive(xSaveRequestSemaphore);
+        }
+    };
+
+    // Para a captura e passa a gravar
+    void stop_capture(void)
+    {
+        capture_running = false;
+        update_system_state(ACESSING);
+        start_save();
     };
 
     update_system_state(WAITING);
 
     while (true)
     {
-        // Verifica se o Botão A foi pressionado
-        if (xSemaphoreTake(xButtonASemaphore, 0) == pdTRUE)
+        // Dorme até um evento: botões, montagem, cartões, buffer cheio ou
+        // fim da gravação
+        EventBits_t bits = xEventGroupWaitBits(xControlEvents, EV_ALL_BITS, pdTRUE, pdFALSE, portMAX_DELAY);
+        uint32_t now = time_us_32();
+        for (ControlEvent ev = 0; ev < EV_COUNT; ++ev)
+            if (bits & (1u << ev))
+                event_latency_add(&event_latency[ev], now - event_time_us[ev]);
+
+        // Botão A
+        if (bits & (1u << EV_BUTTON_A))
         {
-            if (current_mode == READY)
+            if (current_mode == READY || current_mode == WAITING || current_mode == SDMOUNT)
             {
-                // Inicia a captura
+                // Inicia a captura. Ela vai para a RAM, então não precisa
+                // esperar o cartão: a montagem continua em segundo plano.
                 samples_in_buffer = 0;
-                xSemaphoreGive(xBuzzerSemaphore);
+                samples_saved = 0;
+                segment = 0;
+                start_mount();
+                buzzer_play(&beep_single);
                 update_system_state(CAPTURING);
+                capture_running = true;
+                xTaskNotifyGive(xCaptureTaskHandle);
             }
             else if (current_mode == CAPTURING)
             {
                 // Para a captura e inicia a gravação
-                xSemaphoreGive(xBuzzerSemaphore);
-                vTaskDelay(pdMS_TO_TICKS(80));
-                xSemaphoreGive(xBuzzerSemaphore);
-                update_system_state(ACESSING);
+                buzzer_play(&beep_double);
+                stop_capture();
             }
-            else if (current_mode == ACESSING)
+            else if (current_mode == ACESSING && saving)
+            {
+                // A gravação em andamento termina antes de voltar ao READY
+                stop_after_save = true;
+            }
+            else if (current_mode == ACESSING || current_mode == NOCARD)
             {
                 // Para a gravação e retorna ao estado READY
-                xSemaphoreGive(xBuzzerSemaphore);
-                vTaskDelay(pdMS_TO_TICKS(80));
-                xSemaphoreGive(xBuzzerSemaphore);
+                buzzer_play(&beep_double);
                 update_system_state(READY);
             }
             else if (current_mode == ERROR)
@@ -100,151 +289,382 @@ void vControlTask(void *pvParameters)
                 update_system_state(WAITING);
             }
         }
-        // Verifica se o Botão B foi pressionado
-        if (xSemaphoreTake(xButtonBSemaphore, 0) == pdTRUE)
+        // Botão B
+        if (bits & (1u << EV_BUTTON_B))
         {
-            if (!is_mounted)
+            if (current_mode == CAPTURING && (is_mounted || mount_status.busy))
             {
-                // Tenta montar o cartão SD
-                update_system_state(SDMOUNT);
-                vTaskDelay(pdMS_TO_TICKS(50));
-                if (mount_sd_card())
-                {
-                    is_mounted = true;
-                    xSemaphoreGive(xBuzzerSemaphore);
-                    update_system_state(READY);
-                }
+                // Alterna entre os sinais do osciloscópio e o diagnóstico:
+                // |A| -> diagnóstico -> Ax -> Ay -> Az -> |A|
+                if (display_stats)
+                    display_stats = false;
+                else if (scope_tap.signal == SCOPE_SIGNALS - 1)
+                    display_stats = true;
+                if (!display_stats)
+                    scope_next_signal();
+                update_system_state(current_mode);
+            }
+            else if ((current_mode == ACESSING || current_mode == NOCARD) && is_mounted)
+            {
+                display_stats = !display_stats;
+                update_system_state(current_mode);
+            }
+            else if (!is_mounted)
+            {
+                // Tenta montar o cartão SD (em segundo plano)
+                start_mount();
+                if (current_mode == WAITING || current_mode == ERROR)
+                    update_system_state(SDMOUNT);
                 else
-                {
-                    is_mounted = false;
-                    update_system_state(ERROR);
-                }
+                    update_system_state(current_mode);
             }
             else if (current_mode == READY)
             {
                 update_system_state(ACESSING);
+                xSemaphoreTake(xCardMutex, portMAX_DELAY);
                 unmount_sd_card();
+                xSemaphoreGive(xCardMutex);
                 is_mounted = false;
-                xSemaphoreGive(xBuzzerSemaphore);
+                buzzer_play(&beep_single);
                 update_system_state(WAITING);
             }
         }
-        // Se estiver no modo de captura, coleta dados do IMU e armazena no buffer
-        if (current_mode == CAPTURING)
+        // Resultado da montagem em segundo plano
+        if (bits & (1u << EV_MOUNT_DONE))
         {
-            if (samples_in_buffer < MAX_SAMPLES)
-            {
-                // Lê o sensor e armazena no buffer
-                int16_t aceleracao[3], gyro[3], temp;
-                mpu6050_read_raw(aceleracao, gyro, &temp);
-
-                rtc_get_datetime(&data_buffer[samples_in_buffer].timestamp);
-                data_buffer[samples_in_buffer].sample_num = samples_in_buffer + 1;
-                data_buffer[samples_in_buffer].accel_x = aceleracao[0] / 16384.0f;
-                data_buffer[samples_in_buffer].accel_y = aceleracao[1] / 16384.0f;
-                data_buffer[samples_in_buffer].accel_z = aceleracao[2] / 16384.0f;
-                data_buffer[samples_in_buffer].gyro_x = gyro[0] / 131.0f;
-                data_buffer[samples_in_buffer].gyro_y = gyro[1] / 131.0f;
-                data_buffer[samples_in_buffer].gyro_z = gyro[2] / 131.0f;
-                samples_in_buffer++;
-                if (samples_in_buffer % 5 == 0)
-                {
-                    update_system_state(CAPTURING);
-                }
-            }
+            is_mounted = mount_ok;
+            if (is_mounted)
+                buzzer_play(&beep_single);
+            if (current_mode == SDMOUNT)
+                update_system_state(is_mounted ? READY : ERROR);
+            else if (current_mode == ACESSING)
+                start_save();
             else
-            {
-                // Se o buffer encher, inicia a gravação automaticamente
-                update_system_state(ACESSING);
-            }
-            vTaskDelay(pdMS_TO_TICKS(100));
+                update_system_state(current_mode);
         }
-        // Se estiver no modo de acesso, salva os dados da RAM no SD
-        else if (current_mode == ACESSING)
+        // A captura encheu o buffer: inicia a gravação automaticamente
+        if ((bits & (1u << EV_BUFFER_FULL)) && current_mode == CAPTURING)
         {
-            FRESULT fr;
-            UINT bytes_written;
-
-            fr = f_open(&file, filename, FA_WRITE | FA_CREATE_ALWAYS);
-            if (fr != FR_OK)
+            stop_capture();
+        }
+        // Fim da gravação
+        if (bits & (1u << EV_SAVE_DONE))
+        {
+            saving = false;
+            print_event_latency(event_latency);
+            if (save_result == SAVE_LOST)
+            {
+                segment++;
+                update_system_state(NOCARD);
+            }
+            else if (save_result == SAVE_ERROR)
             {
                 update_system_state(ERROR);
-                continue;
             }
-            
-            // Escreve o cabeçalho no arquivo
-            const char *header = "numero_amostra,accel_x,accel_y,accel_z,giro_x,giro_y,giro_z,data_hora\n";
-            f_write(&file, header, strlen(header), &bytes_written);
-
-            char buffer[150];
-            bool write_error = false;
-            // Percorre o buffer da RAM e escreve cada amostra no arquivo
-            for (int i = 0; i < samples_in_buffer; i++)
+            else if (stop_after_save)
             {
-                ImuSample *s = &data_buffer[i];
-                int len = snprintf(buffer, sizeof(buffer),
-                                   "%lu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%02d/%02d/%04d-%02d:%02d:%02d\n",
-                                   s->sample_num, s->accel_x, s->accel_y, s->accel_z,
-                                   s->gyro_x, s->gyro_y, s->gyro_z,
-                                   s->timestamp.day, s->timestamp.month, s->timestamp.year,
-                                   s->timestamp.hour, s->timestamp.min, s->timestamp.sec);
-
-                fr = f_write(&file, buffer, len, &bytes_written);
-                if (fr != FR_OK || bytes_written < len)
-                {
-                    write_error = true;
-                    break;
-                }
-                // Envia uma atualização para o display a cada 100 amostras salvas
-                if (i > 0 && i % 100 == 0)
-                {
-                    DisplayMessage prog_msg = {.new_mode = ACESSING, .sample_count = i};
-                    xQueueSend(xDisplayQueue, &prog_msg, 0);
-                }
+                buzzer_play(&beep_double);
+                update_system_state(READY);
             }
-            // Garante que todos os dados foram escritos e fecha o arquivo
-            f_sync(&file);
-            f_close(&file);
-
-            if (write_error)
+            else
             {
-                update_system_state(ERROR);
+                update_system_state(ACESSING);
             }
+            stop_after_save = false;
         }
-        else
+        // Cartão removido: o monitor remonta o cartão 0 quando ele voltar
+        // (ou o botão B monta de novo)
+        if ((bits & ((1u << EV_CARD_CHANGE) | (1u << EV_MOUNT_DONE))) && current_mode == NOCARD &&
+            is_mounted && sd_get_by_num(0)->mounted)
         {
-            vTaskDelay(pdMS_TO_TICKS(20));
+            update_system_state(ACESSING);
+            start_save();
         }
     }
 }
 
-void vBuzzerTask(void *pvParameters)
+// Amostragem no período exato (vTaskDelayUntil), independente da
+// vControlTask e do display. Dorme enquanto não há captura.
+void vCaptureTask(void *pvParameters)
 {
-    pwm_init_buzzer(BUZZER_PIN_A);
     while (true)
     {
-        if (xSemaphoreTake(xBuzzerSemaphore, portMAX_DELAY) == pdTRUE)
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        TickType_t wake = xTaskGetTickCount();
+        uint32_t last_sample_us = 0; // Instante da última amostra (0: nenhuma)
+        while (capture_running)
         {
-            beep(BUZZER_PIN_A, 100);
+            if (samples_in_buffer >= MAX_SAMPLES)
+            {
+                capture_running = false;
+                signal_event(EV_BUFFER_FULL);
+                break;
+            }
+            // Lê o sensor e armazena no buffer
+            int16_t aceleracao[3], gyro[3], temp;
+            mpu6050_read_raw(aceleracao, gyro, &temp);
+
+            ImuSample *s = &data_buffer[samples_in_buffer];
+            rtc_get_datetime(&s->timestamp);
+            s->sample_num = samples_in_buffer + 1;
+            s->accel_x = aceleracao[0] / 16384.0f;
+            s->accel_y = aceleracao[1] / 16384.0f;
+            s->accel_z = aceleracao[2] / 16384.0f;
+            s->gyro_x = gyro[0] / 131.0f;
+            s->gyro_y = gyro[1] / 131.0f;
+            s->gyro_z = gyro[2] / 131.0f;
+            scope_tap_push(s);
+            samples_in_buffer++;
+            live_stats.samples++;
+            live_stats.buffered = samples_in_buffer;
+            // Períodos inteiros sem amostra contam como perdidos
+            uint32_t now_us = time_us_32();
+            if (last_sample_us && now_us - last_sample_us >= 2 * SAMPLE_PERIOD_MS * 1000)
+                live_stats.dropped += (now_us - last_sample_us) / (SAMPLE_PERIOD_MS * 1000) - 1;
+            last_sample_us = now_us;
+
+            // Atrasada (períodos perdidos): retoma a partir de agora em vez
+            // de tirar as amostras atrasadas em rajada
+            if (xTaskDelayUntil(&wake, pdMS_TO_TICKS(SAMPLE_PERIOD_MS)) == pdFALSE)
+                wake = xTaskGetTickCount();
         }
     }
 }
 
+// Grava fora da vControlTask, que continua atendendo os botões
+void vSaveTask(void *pvParameters)
+{
+    while (true)
+    {
+        xSemaphoreTake(xSaveRequestSemaphore, portMAX_DELAY);
+        save_result = save_samples();
+        signal_event(EV_SAVE_DONE);
+    }
+}
+
+// Monta os cartões fora da vControlTask: a inicialização de um cartão
+// ausente leva segundos (CMD0 e ACMD41 com timeout), e o f_getfree pode
+// varrer a FAT inteira
+void vMountTask(void *pvParameters)
+{
+    while (true)
+    {
+        xSemaphoreTake(xMountRequestSemaphore, portMAX_DELAY);
+        xSemaphoreTake(xCardMutex, portMAX_DELAY);
+        mount_ok = mount_sd_card(&mount_status);
+#if LOCK_BENCH_SECONDS
+        if (mount_ok)
+            ff_lock_contention_bench(sd_get_by_num(0)->pcName, LOCK_BENCH_WRITERS,
+                                     LOCK_BENCH_SECONDS);
+#endif
+        xSemaphoreGive(xCardMutex);
+        mount_status.busy = false;
+        signal_event(EV_MOUNT_DONE);
+    }
+}
+
+// Verifica periodicamente se os cartões montados continuam presentes e
+// remonta os que forem reinseridos. Não há pino de detecção livre (o GPIO 22
+// é o botão J), então a presença é testada com comandos ao cartão.
+void vCardMonitorTask(void *pvParameters)
+{
+    while (true)
+    {
+        vTaskDelay(pdMS_TO_TICKS(CARD_MONITOR_PERIOD_MS));
+        // Durante a gravação quem detecta a remoção é a própria escrita
+        if (xSemaphoreTake(xCardMutex, 0) == pdTRUE)
+        {
+            uint32_t before = mounted_sd_cards();
+            check_sd_cards();
+            uint32_t after = mounted_sd_cards();
+            xSemaphoreGive(xCardMutex);
+            if (before != after)
+                signal_event(EV_CARD_CHANGE);
+        }
+    }
+}
+
+static void display_done(ssd1306_t *ssd)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    xSemaphoreGiveFromISR(xDisplayDoneSemaphore, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+// Faixa de cada sinal do osciloscópio, em g
+static const struct
+{
+    const char *name;
+    float min, max;
+} scope_signals[SCOPE_SIGNALS] = {
+    [SCOPE_ACCEL_X] = {"Ax", -2.0f, 2.0f},
+    [SCOPE_ACCEL_Y] = {"Ay", -2.0f, 2.0f},
+    [SCOPE_ACCEL_Z] = {"Az", -2.0f, 2.0f},
+    [SCOPE_ACCEL_MAG] = {"|A|", 0.0f, 2.0f},
+};
+
+// Área do traço: páginas 2 a 7 (linhas 16 a 63), a tela toda na horizontal
+#define SCOPE_TOP 16
+#define SCOPE_BOTTOM 63
+
+static uint8_t scope_y(float value, ScopeSignal signal)
+{
+    float min = scope_signals[signal].min, max = scope_signals[signal].max;
+    if (value < min)
+        value = min;
+    if (value > max)
+        value = max;
+    return SCOPE_BOTTOM - (uint8_t)((value - min) / (max - min) * (SCOPE_BOTTOM - SCOPE_TOP) + 0.5f);
+}
+
+// Tela de captura: só a coluna nova do traço e o cabeçalho mudam, então o
+// envio parcial manda a área do traço e a linha de texto que mudou
+static void draw_scope(ssd1306_t *ssd, bool restart)
+{
+    static ScopeSignal signal;
+    static uint8_t last_y;
+    static float last_value;
+    char buffer[20];
+    float value;
+
+    if (restart || signal != scope_tap.signal)
+    {
+        signal = scope_tap.signal;
+        // Descarta os pontos acumulados enquanto o traço não era mostrado
+        while (scope_tap_pop(&value))
+            ;
+        ssd1306_fill(ssd, 0);
+        last_y = scope_y(0, signal);
+        last_value = 0;
+    }
+    while (scope_tap_pop(&value))
+    {
+        uint8_t y = scope_y(value, signal);
+        ssd1306_scroll_left(ssd, 0, ssd->width - 1, SCOPE_TOP / 8, SCOPE_BOTTOM / 8);
+        // Liga o ponto anterior ao novo para o traço não ficar pontilhado
+        if (y < last_y)
+            ssd1306_vline(ssd, ssd->width - 1, y, last_y, true);
+        else
+            ssd1306_vline(ssd, ssd->width - 1, last_y, y, true);
+        last_y = y;
+        last_value = value;
+    }
+
+    ssd1306_rect(ssd, 0, 0, ssd->width, SCOPE_TOP, false, true);
+    sprintf(buffer, "%s %.2fg", scope_signals[signal].name, last_value);
+    ssd1306_draw_string(ssd, buffer, 0, 0);
+    // A contagem vem direto da captura, sem mensagens a cada amostra
+    if (mount_status.busy)
+        sprintf(buffer, "%lu SD:%u%%", live_stats.buffered, mount_status.progress);
+    else
+        sprintf(buffer, "Amostras: %lu", live_stats.buffered);
+    ssd1306_draw_string(ssd, buffer, 0, 8);
+}
+
+// Tela de diagnóstico: lê live_stats sem bloquear a captura nem a gravação.
+// As taxas são calculadas pela diferença desde a leitura anterior.
+static void draw_stats(ssd1306_t *ssd)
+{
+    static uint32_t last_us, last_samples, last_bytes;
+    static float rate, mbps;
+    char buffer[20];
+
+    uint32_t now = time_us_32();
+    uint32_t bytes = 0, worst_us = 0;
+    for (size_t i = 0; i < LOG_STORAGE_MAX_CARDS; ++i)
+    {
+        bytes += live_stats.sd_bytes[i];
+        if (live_stats.sd_write_us_max[i] > worst_us)
+            worst_us = live_stats.sd_write_us_max[i];
+    }
+    uint32_t samples = live_stats.samples;
+    uint32_t dt = now - last_us;
+    if (dt >= STATS_REFRESH_MS * 1000)
+    {
+        if (last_us)
+        {
+            rate = (samples - last_samples) * 1e6f / dt;
+            mbps = (bytes - last_bytes) / (float)dt; // bytes/µs = MB/s
+        }
+        last_us = now;
+        last_samples = samples;
+        last_bytes = bytes;
+    }
+
+    ssd1306_fill(ssd, 0);
+    ssd1306_draw_string(ssd, "DIAGNOSTICO", 20, 0);
+    sprintf(buffer, "Taxa: %.1f Hz", rate);
+    ssd1306_draw_string(ssd, buffer, 0, 12);
+    sprintf(buffer, "Buffer: %lu%%", live_stats.buffered * 100 / MAX_SAMPLES);
+    ssd1306_draw_string(ssd, buffer, 0, 20);
+    sprintf(buffer, "Perdidas: %lu", live_stats.dropped);
+    ssd1306_draw_string(ssd, buffer, 0, 28);
+    sprintf(buffer, "SD: %.3f MB/s", mbps);
+    ssd1306_draw_string(ssd, buffer, 0, 36);
+    sprintf(buffer, "Pior: %.1f ms", worst_us / 1000.0f);
+    ssd1306_draw_string(ssd, buffer, 0, 44);
+    sprintf(buffer, "Livre: %lu MB", mount_status.free_mb);
+    ssd1306_draw_string(ssd, buffer, 0, 52);
+}
+
 void vDisplayTask(void *pvParameters)
 {
     ssd1306_t ssd;
     ssd1306_init(&ssd, 128, 64, false, DISPLAY_ADDRESS, I2C_PORT_DISP);
     ssd1306_config(&ssd);
+    // Sem canal de DMA livre os envios continuam bloqueantes
+    ssd1306_dma_init(&ssd, display_done);
 
     DisplayMessage msg = {.new_mode = WAITING, .sample_count = 0};
 
     ssd1306_fill(&ssd, 0);
-    ssd1306_send_data(&ssd);
+    bool sending = ssd1306_send_data_async(&ssd);
+
+    bool scope_shown = false; // O último quadro foi o osciloscópio
+    TickType_t last_frame = xTaskGetTickCount();
 
     while (true)
     {
-        // Aguarda uma nova mensagem na fila
-        xQueueReceive(xDisplayQueue, &msg, portMAX_DELAY);
+        // Aguarda uma nova mensagem na fila. Durante a captura o osciloscópio
+        // é redesenhado a cada SCOPE_FRAME_MS, e durante a montagem a tela é
+        // redesenhada periodicamente para mostrar o progresso.
+        bool stats = display_stats && (msg.new_mode == CAPTURING || msg.new_mode == ACESSING ||
+                                       msg.new_mode == NOCARD);
+        TickType_t wait = portMAX_DELAY;
+        if (stats)
+            wait = pdMS_TO_TICKS(STATS_REFRESH_MS);
+        else if (msg.new_mode == CAPTURING)
+            wait = pdMS_TO_TICKS(SCOPE_FRAME_MS);
+        else if (mount_status.busy)
+            wait = pdMS_TO_TICKS(200);
+        xQueueReceive(xDisplayQueue, &msg, wait);
+        // Limita a taxa de quadros. Se chegou um estado novo durante a
+        // espera, ele substitui o recebido.
+        TickType_t elapsed = xTaskGetTickCount() - last_frame;
+        if (elapsed < pdMS_TO_TICKS(DISPLAY_FRAME_MS))
+        {
+            vTaskDelay(pdMS_TO_TICKS(DISPLAY_FRAME_MS) - elapsed);
+            xQueueReceive(xDisplayQueue, &msg, 0);
+        }
+        last_frame = xTaskGetTickCount();
+
+        // O estado (e a tela escolhida) pode ter mudado durante a espera
+        stats = display_stats && (msg.new_mode == CAPTURING || msg.new_mode == ACESSING ||
+                                  msg.new_mode == NOCARD);
+        if (stats || msg.new_mode == CAPTURING)
+        {
+            if (stats)
+                draw_stats(&ssd);
+            else
+                draw_scope(&ssd, !scope_shown);
+            scope_shown = !stats;
+            if (sending)
+                xSemaphoreTake(xDisplayDoneSemaphore, portMAX_DELAY);
+            sending = ssd1306_send_data_async(&ssd);
+            continue;
+        }
+        scope_shown = false;
+
         ssd1306_fill(&ssd, 0);
         ssd1306_rect(&ssd, 2, 2, 124, 60, true, false);
         ssd1306_draw_string(&ssd, "DATALOGGER", 25, 5);
@@ -259,22 +679,34 @@ void vDisplayTask(void *pvParameters)
             ssd1306_draw_string(&ssd, "card", 8, 46);
             break;
         case SDMOUNT:
-            ssd1306_draw_string(&ssd, "Montando o ", 8, 22);
-            ssd1306_draw_string(&ssd, "cartao SD...", 8, 34);
+            ssd1306_draw_string(&ssd, "Montando o SD", 8, 22);
+            sprintf(buffer, "%s %s", mount_status.stage, mount_status.card);
+            ssd1306_draw_string(&ssd, buffer, 8, 34);
+            // Barra de progresso
+            ssd1306_rect(&ssd, 47, 8, 112, 8, true, false);
+            ssd1306_rect(&ssd, 49, 10, 108 * mount_status.progress / 100, 4, true, true);
             break;
         case READY:
             ssd1306_draw_string(&ssd, "Pronto para", 8, 22);
             ssd1306_draw_string(&ssd, "gravar.", 8, 34);
-            break;
-        case CAPTURING:
-            ssd1306_draw_string(&ssd, "Capturando...", 8, 22);
-            sprintf(buffer, "Amostras: %lu", msg.sample_count);
-            ssd1306_draw_string(&ssd, buffer, 8, 34);
+            sprintf(buffer, "Livre: %lu MB", mount_status.free_mb);
+            ssd1306_draw_string(&ssd, buffer, 8, 46);
             break;
         case ACESSING:
             ssd1306_draw_string(&ssd, "Salvando...", 8, 22);
             sprintf(buffer, "Salvos: %lu", msg.sample_count);
             ssd1306_draw_string(&ssd, buffer, 8, 34);
+            if (mount_status.busy)
+            {
+                sprintf(buffer, "SD: %u%%", mount_status.progress);
+                ssd1306_draw_string(&ssd, buffer, 8, 46);
+            }
+            break;
+        case NOCARD:
+            ssd1306_draw_string(&ssd, "Cartao removido", 8, 22);
+            sprintf(buffer, "Na RAM: %lu", msg.sample_count);
+            ssd1306_draw_string(&ssd, buffer, 8, 34);
+            ssd1306_draw_string(&ssd, "Reinsira o SD", 8, 46);
             break;
         case ERROR:
             ssd1306_draw_string(&ssd, "ERRO!", 8, 22);
@@ -285,63 +717,10 @@ void vDisplayTask(void *pvParameters)
             ssd1306_draw_string(&ssd, "Estado desconhecido", 8, 22);
             break;
         }
-        ssd1306_send_data(&ssd);
-    }
-}
-
-void vLedTask(void *pvParameters)
-{
-    gpio_init(LED_PIN_GREEN);
-    gpio_init(LED_PIN_RED);
-    gpio_init(LED_PIN_BLUE);
-    gpio_set_dir(LED_PIN_GREEN, GPIO_OUT);
-    gpio_set_dir(LED_PIN_RED, GPIO_OUT);
-    gpio_set_dir(LED_PIN_BLUE, GPIO_OUT);
-
-    DisplayMessage msg = {.new_mode = WAITING};
-
-    while (true)
-    {
-        xQueueReceive(xLedQueue, &msg, pdMS_TO_TICKS(250));
-        bool led_state = (to_ms_since_boot(get_absolute_time()) / 250) % 2;
-
-        switch (msg.new_mode)
-        {
-        case WAITING: // Branco
-            gpio_put(LED_PIN_RED, true);
-            gpio_put(LED_PIN_GREEN, true);
-            gpio_put(LED_PIN_BLUE, true);
-            break;
-        case SDMOUNT: // Amarelo
-            gpio_put(LED_PIN_RED, true);
-            gpio_put(LED_PIN_GREEN, true);
-            gpio_put(LED_PIN_BLUE, false);
-            break;
-        case READY: // Verde
-            gpio_put(LED_PIN_RED, false);
-            gpio_put(LED_PIN_GREEN, true);
-            gpio_put(LED_PIN_BLUE, false);
-            break;
-        case CAPTURING: // Vermelho
-            gpio_put(LED_PIN_RED, true);
-            gpio_put(LED_PIN_GREEN, false);
-            gpio_put(LED_PIN_BLUE, false);
-            break;
-        case ACESSING: // Azul Piscando
-            gpio_put(LED_PIN_RED, false);
-            gpio_put(LED_PIN_GREEN, false);
-            gpio_put(LED_PIN_BLUE, led_state);
-            break;
-        case ERROR: // Roxo Piscando
-            gpio_put(LED_PIN_RED, led_state);
-            gpio_put(LED_PIN_GREEN, false);
-            gpio_put(LED_PIN_BLUE, led_state);
-            break;
-        default: // Apagado
-            gpio_put(LED_PIN_RED, false);
-            gpio_put(LED_PIN_GREEN, false);
-            gpio_put(LED_PIN_BLUE, false);
-        }
+        // O quadro anterior foi enviado enquanto este era desenhado
+        if (sending)
+            xSemaphoreTake(xDisplayDoneSemaphore, portMAX_DELAY);
+        sending = ssd1306_send_data_async(&ssd);
     }
 }
 
@@ -388,18 +767,25 @@ int main()
     gpio_set_irq_enabled_with_callback(BUTTON_B, GPIO_IRQ_EDGE_FALL, true, &gpio_irq_handler);
     gpio_set_irq_enabled(BUTTON_J, GPIO_IRQ_EDGE_FALL, true);
 
+    buzzer_init(BUZZER_PIN_A);
+    status_led_init(LED_PIN_RED, LED_PIN_GREEN, LED_PIN_BLUE);
+
     // Cria as filas e semáforos do FreeRTOS
-    xBuzzerSemaphore = xSemaphoreCreateBinary();
-    xButtonASemaphore = xSemaphoreCreateBinary();
-    xButtonBSemaphore = xSemaphoreCreateBinary();
-    xDisplayQueue = xQueueCreate(5, sizeof(DisplayMessage));
-    xLedQueue = xQueueCreate(5, sizeof(DisplayMessage));
+    xControlEvents = xEventGroupCreate();
+    xCardMutex = xSemaphoreCreateMutex();
+    xMountRequestSemaphore = xSemaphoreCreateBinary();
+    xSaveRequestSemaphore = xSemaphoreCreateBinary();
+    xDisplayDoneSemaphore = xSemaphoreCreateBinary();
+    // Caixa de mensagem: xQueueOverwrite mantém só o estado mais recente
+    xDisplayQueue = xQueueCreate(1, sizeof(DisplayMessage));
 
     // Cria as tarefas
     xTaskCreate(vDisplayTask, "DisplayTask", 1024, NULL, 2, NULL);
-    xTaskCreate(vLedTask, "LedTask", 256, NULL, 1, NULL);
-    xTaskCreate(vBuzzerTask, "BuzzerTask", 256, NULL, 1, NULL);
-    xTaskCreate(vControlTask, "ControlTask", 2048, NULL, 3, NULL);
+    xTaskCreate(vCardMonitorTask, "CardMonitorTask", 1024, NULL, 1, NULL);
+    xTaskCreate(vMountTask, "MountTask", 1024, NULL, 1, NULL);
+    xTaskCreate(vSaveTask, "SaveTask", 2048, NULL, 2, NULL);
+    xTaskCreate(vControlTask, "ControlTask", 1024, NULL, 3, NULL);
+    xTaskCreate(vCaptureTask, "CaptureTask", 512, NULL, 4, &xCaptureTaskHandle);
 
     vTaskStartScheduler();
 
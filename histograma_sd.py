@@ -0,0 +1,104 @@
+import argparse
+import os
+import struct
+from collections import defaultdict
+
+# Lê o trace de comandos do driver SD (sd_trace.h) e mostra histogramas de
+# latência por comando e por cartão. Aceita o arquivo binário gravado por
+# sd_trace_save (sdtrace.bin) ou uma captura da serial com as linhas
+# "sdtrace,..." impressas por sd_trace_dump.
+
+MAGIC = 0x52544453  # "SDTR"
+CABECALHO = struct.Struct('<IHHII')        # magic, versao, tam_registro, n, perdidos
+REGISTRO = struct.Struct('<IIIHBBBBH')     # sd_trace_entry_t
+ACMD = 0x80
+SEM_RESPOSTA = 0xFF
+
+NOMES = {0: 'GO_IDLE', 8: 'SEND_IF_COND', 9: 'SEND_CSD', 10: 'SEND_CID',
+         12: 'STOP_TRAN', 13: 'SEND_STATUS', 16: 'SET_BLOCKLEN',
+         17: 'READ_SINGLE', 18: 'READ_MULTI', 24: 'WRITE_SINGLE',
+         25: 'WRITE_MULTI', 32: 'ERASE_START', 33: 'ERASE_END', 38: 'ERASE',
+         55: 'APP_CMD', 58: 'READ_OCR', 59: 'CRC_ON_OFF'}
+
+def nome_comando(cmd):
+    if cmd & ACMD:
+        return f"ACMD{cmd & ~ACMD}"
+    return f"CMD{cmd} {NOMES.get(cmd, '')}".strip()
+
+def ler_binario(caminho):
+    with open(caminho, 'rb') as f:
+        dados = f.read()
+    magic, versao, tamanho, n, perdidos = CABECALHO.unpack_from(dados)
+    if magic != MAGIC or tamanho != REGISTRO.size:
+        raise ValueError(f"'{caminho}' não é um trace SD (versão {versao})")
+    registros = []
+    for i in range(n):
+        inicio, fim, arg, ocupado, cmd, tentativas, cartao, status, erro = \
+            REGISTRO.unpack_from(dados, CABECALHO.size + i * REGISTRO.size)
+        registros.append(dict(cartao=cartao, cmd=cmd, arg=arg, inicio=inicio, fim=fim,
+                              ocupado=ocupado, tentativas=tentativas, status=status, erro=erro))
+    return registros, perdidos
+
+def ler_texto(caminho):
+    registros = []
+    with open(caminho, errors='replace') as f:
+        for linha in f:
+            campos = linha.strip().split(',')
+            if len(campos) != 10 or campos[0] != 'sdtrace' or campos[1] == 'card':
+                continue
+            cmd = campos[2]
+            cmd = (int(cmd[1:]) | ACMD) if cmd.startswith('A') else int(cmd)
+            cartao, arg, inicio, fim, ocupado, tentativas, status, erro = \
+                int(campos[1]), int(campos[3], 16), *map(int, campos[4:])
+            registros.append(dict(cartao=cartao, cmd=cmd, arg=arg, inicio=inicio, fim=fim,
+                                  ocupado=ocupado, tentativas=tentativas, status=status, erro=erro))
+    return registros, 0
+
+def percentil(valores, p):
+    valores = sorted(valores)
+    return valores[min(len(valores) - 1, int(p / 100 * len(valores)))]
+
+def histograma(valores, largura=40):
+    # Faixas em potências de 2 (µs)
+    faixas = defaultdict(int)
+    for v in valores:
+        faixas[max(v, 1).bit_length()] += 1
+    maior = max(faixas.values())
+    for b in range(min(faixas), max(faixas) + 1):
+        n = faixas.get(b, 0)
+        barra = '#' * round(n * largura / maior)
+        print(f"    {1 << (b - 1):>8} - {(1 << b) - 1:<8} µs {n:6d} {barra}")
+
+def analisar(registros, mostrar_histograma):
+    grupos = defaultdict(list)
+    for r in registros:
+        grupos[(r['cartao'], r['cmd'])].append(r)
+    for (cartao, cmd), rs in sorted(grupos.items()):
+        # time_us_32 dá a volta a cada ~71 minutos
+        lat = [(r['fim'] - r['inicio']) & 0xFFFFFFFF for r in rs]
+        ocupado = [r['ocupado'] for r in rs]
+        erros = sum(1 for r in rs if r['erro'])
+        tentativas = sum(r['tentativas'] for r in rs)
+        print(f"Cartão {cartao} {nome_comando(cmd)}: {len(rs)} comandos, {erros} erros, {tentativas} reenvios")
+        print(f"  latência µs: p50 {percentil(lat, 50)}, p90 {percentil(lat, 90)}, "
+              f"p99 {percentil(lat, 99)}, máx {max(lat)}")
+        print(f"  ocupado  µs: p50 {percentil(ocupado, 50)}, p99 {percentil(ocupado, 99)}, máx {max(ocupado)}")
+        if mostrar_histograma:
+            histograma(lat)
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Histogramas de latência dos comandos SD (sd_trace).')
+    parser.add_argument('arquivo', nargs='?', default='sdtrace.bin',
+                        help='sdtrace.bin ou captura da serial com linhas "sdtrace,"')
+    parser.add_argument('--resumo', action='store_true', help='só os percentis, sem histogramas')
+    args = parser.parse_args()
+
+    if not os.path.exists(args.arquivo):
+        print(f"Erro: Arquivo '{args.arquivo}' não encontrado!")
+    else:
+        with open(args.arquivo, 'rb') as f:
+            binario = f.read(4) == struct.pack('<I', MAGIC)
+        registros, perdidos = (ler_binario if binario else ler_texto)(args.arquivo)
+        print(f"{len(registros)} comandos em '{args.arquivo}' ({perdidos} sobrescritos no anel)")
+        if registros:
+            analisar(registros, not args.resumo)
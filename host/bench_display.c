@@ -0,0 +1,54 @@
+// Mede no PC quanto tempo o lib/ssd1306.c leva para desenhar a tela de
+// captura (a mais frequente). O I2C e o DMA são stubs (host/include), então
+// só o desenho no buffer é medido. Opcionalmente grava o quadro final, para
+// conferir que duas versões desenham o mesmo:
+//
+//   gcc -O2 -Ihost/include -Ilib host/bench_display.c host/pico_stubs.c lib/ssd1306.c -o bench_display
+//   ./bench_display [quadros] [quadro.bin]
+//
+// Para comparar com outra versão, compile com o ssd1306.c/.h dela no lugar
+// dos de lib/ (o font.h continua vindo de lib/).
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ssd1306.h"
+
+static void render(ssd1306_t *ssd, int n) {
+  char buf[32];
+  ssd1306_fill(ssd, false);
+  ssd1306_rect(ssd, 2, 2, 124, 60, true, false);
+  ssd1306_draw_string(ssd, "DATALOGGER", 25, 5);
+  ssd1306_line(ssd, 3, 15, 125, 15, true);
+  ssd1306_draw_string(ssd, "Capturando...", 8, 22);
+  snprintf(buf, sizeof buf, "Amostras: %d", n);
+  ssd1306_draw_string(ssd, buf, 8, 34);
+  ssd1306_rect(ssd, 47, 8, 112, 8, true, false);
+  ssd1306_rect(ssd, 49, 10, 1 + n % 100, 4, true, true);
+  ssd1306_draw_string(ssd, "SD: 42%", 8, 51);
+}
+
+int main(int argc, char **argv) {
+  int frames = argc > 1 ? atoi(argv[1]) : 20000;
+  ssd1306_t ssd;
+  ssd1306_init(&ssd, WIDTH, HEIGHT, false, 0x3C, i2c1);
+
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (int i = 0; i < frames; i++)
+    render(&ssd, i);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  double us = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / 1e3;
+  printf("%d quadros, %.2f us por quadro\n", frames, us / frames);
+
+  if (argc > 2) {
+    render(&ssd, 1234);
+    FILE *f = fopen(argv[2], "wb");
+    if (!f) {
+      perror(argv[2]);
+      return 1;
+    }
+    fwrite(ssd.ram_buffer, 1, ssd.bufsize, f);
+    fclose(f);
+  }
+  return 0;
+}
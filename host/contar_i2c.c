@@ -0,0 +1,35 @@
+// Conta no PC as transações e os bytes de I2C que o lib/ssd1306.c gera para
+// configurar o display, enviar um quadro inteiro e enviar só o contador de
+// amostras alterado. Usa os stubs de host/include (o I2C só conta):
+//
+//   gcc -O2 -Ihost/include -Ilib host/contar_i2c.c host/pico_stubs.c lib/ssd1306.c -o contar_i2c
+//   ./contar_i2c
+//
+// Para comparar com outra versão, compile com o ssd1306.c/.h dela no lugar
+// dos de lib/, como no bench_display.c.
+#include <stdio.h>
+#include "ssd1306.h"
+
+extern long i2c_transactions, i2c_bytes;
+
+static void report(const char *what) {
+  printf("%-15s %3ld transacoes, %5ld bytes\n", what, i2c_transactions, i2c_bytes);
+  i2c_transactions = i2c_bytes = 0;
+}
+
+int main(void) {
+  ssd1306_t ssd;
+  ssd1306_init(&ssd, WIDTH, HEIGHT, false, 0x3C, i2c1);
+
+  ssd1306_config(&ssd);
+  report("config:");
+
+  ssd1306_fill(&ssd, true);
+  ssd1306_send_data(&ssd);
+  report("quadro inteiro:");
+
+  ssd1306_draw_string(&ssd, "12", 40, 34);
+  ssd1306_send_data(&ssd);
+  report("contador:");
+  return 0;
+}
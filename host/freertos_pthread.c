@@ -0,0 +1,310 @@
+// Implementação de host/include/FreeRTOS.h e afins com threads POSIX, para
+// rodar código da lib/FatFs_SPI no PC. Não há escalonador: as tarefas rodam
+// todas ao mesmo tempo e a prioridade é ignorada. Um tick é 1 ms.
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "semphr.h"
+#include "task.h"
+#include "timers.h"
+
+static uint64_t agora_us(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000ull + t.tv_nsec / 1000;
+}
+
+uint32_t time_us_32(void) { return (uint32_t)agora_us(); }
+
+// Prazo absoluto (CLOCK_MONOTONIC) para esperar `ticks` a partir de agora
+static struct timespec prazo(TickType_t ticks) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  t.tv_sec += ticks / 1000;
+  t.tv_nsec += (ticks % 1000) * 1000000L;
+  if (t.tv_nsec >= 1000000000L) {
+    t.tv_sec++;
+    t.tv_nsec -= 1000000000L;
+  }
+  return t;
+}
+
+static void cond_init(pthread_cond_t *c) {
+  pthread_condattr_t a;
+  pthread_condattr_init(&a);
+  pthread_condattr_setclock(&a, CLOCK_MONOTONIC);
+  pthread_cond_init(c, &a);
+  pthread_condattr_destroy(&a);
+}
+
+// Espera em `c` até o prazo (portMAX_DELAY: sem prazo); false se esgotou
+static bool cond_wait(pthread_cond_t *c, pthread_mutex_t *m, TickType_t espera,
+                      const struct timespec *limite) {
+  if (portMAX_DELAY == espera) return !pthread_cond_wait(c, m);
+  return ETIMEDOUT != pthread_cond_timedwait(c, m, limite);
+}
+
+/* Tarefas e notificações */
+
+struct tskTaskControlBlock {
+  pthread_t thread;
+  TaskFunction_t codigo;
+  void *parametro;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  uint32_t valor;   // Valor da notificação
+  bool pendente;    // Há notificação não lida
+};
+
+static __thread struct tskTaskControlBlock *atual;
+
+static struct tskTaskControlBlock *nova_tarefa(void) {
+  struct tskTaskControlBlock *t = calloc(1, sizeof *t);
+  pthread_mutex_init(&t->mutex, NULL);
+  cond_init(&t->cond);
+  return t;
+}
+
+static void *trampolim(void *arg) {
+  atual = arg;
+  atual->codigo(atual->parametro);
+  return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stack_depth,
+                       void *parameters, UBaseType_t priority, TaskHandle_t *created_task) {
+  struct tskTaskControlBlock *t = nova_tarefa();
+  t->codigo = code;
+  t->parametro = parameters;
+  if (created_task) *created_task = t;
+  if (pthread_create(&t->thread, NULL, trampolim, t)) return pdFAIL;
+  pthread_detach(t->thread);
+  return pdPASS;
+}
+
+// A thread principal vira tarefa na primeira vez que pede o próprio handle
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  if (!atual) atual = nova_tarefa();
+  return atual;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  struct timespec t = {ticks / 1000, (ticks % 1000) * 1000000L};
+  nanosleep(&t, NULL);
+}
+
+static uint64_t inicio_us;
+
+TickType_t xTaskGetTickCount(void) {
+  if (!inicio_us) inicio_us = agora_us();
+  return (agora_us() - inicio_us) / 1000;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t wait) {
+  struct tskTaskControlBlock *t = xTaskGetCurrentTaskHandle();
+  struct timespec limite = prazo(wait);
+  pthread_mutex_lock(&t->mutex);
+  while (!t->valor && wait && cond_wait(&t->cond, &t->mutex, wait, &limite)) {
+  }
+  uint32_t v = t->valor;
+  if (v) t->valor = clear_on_exit ? 0 : v - 1;
+  pthread_mutex_unlock(&t->mutex);
+  return v;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+  pthread_mutex_lock(&task->mutex);
+  switch (action) {
+    case eSetBits: task->valor |= value; break;
+    case eIncrement: task->valor++; break;
+    case eSetValueWithOverwrite: task->valor = value; break;
+    default: break;
+  }
+  task->pendente = true;
+  pthread_cond_broadcast(&task->cond);
+  pthread_mutex_unlock(&task->mutex);
+  return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) { return xTaskNotify(task, 0, eIncrement); }
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit,
+                           uint32_t *value, TickType_t wait) {
+  struct tskTaskControlBlock *t = xTaskGetCurrentTaskHandle();
+  struct timespec limite = prazo(wait);
+  pthread_mutex_lock(&t->mutex);
+  if (!t->pendente) t->valor &= ~clear_on_entry;
+  while (!t->pendente && wait && cond_wait(&t->cond, &t->mutex, wait, &limite)) {
+  }
+  BaseType_t ok = t->pendente;
+  if (value) *value = t->valor;
+  if (ok) t->valor &= ~clear_on_exit;
+  t->pendente = false;
+  pthread_mutex_unlock(&t->mutex);
+  return ok;
+}
+
+/* Filas */
+
+struct QueueDefinition {
+  pthread_mutex_t mutex;
+  pthread_cond_t mudou;  // Entrou ou saiu um item
+  UBaseType_t tamanho, item, inicio, quantos;
+  uint8_t *dados;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  QueueHandle_t q = calloc(1, sizeof *q);
+  pthread_mutex_init(&q->mutex, NULL);
+  cond_init(&q->mudou);
+  q->tamanho = length;
+  q->item = item_size;
+  q->dados = malloc(length * item_size);
+  return q;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+  free(queue->dados);
+  free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait) {
+  struct timespec limite = prazo(wait);
+  pthread_mutex_lock(&queue->mutex);
+  while (queue->quantos == queue->tamanho && wait &&
+         cond_wait(&queue->mudou, &queue->mutex, wait, &limite)) {
+  }
+  BaseType_t ok = queue->quantos < queue->tamanho;
+  if (ok) {
+    UBaseType_t fim = (queue->inicio + queue->quantos++) % queue->tamanho;
+    memcpy(queue->dados + fim * queue->item, item, queue->item);
+    pthread_cond_broadcast(&queue->mudou);
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  return ok;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait) {
+  struct timespec limite = prazo(wait);
+  pthread_mutex_lock(&queue->mutex);
+  while (!queue->quantos && wait && cond_wait(&queue->mudou, &queue->mutex, wait, &limite)) {
+  }
+  BaseType_t ok = queue->quantos > 0;
+  if (ok) {
+    memcpy(item, queue->dados + queue->inicio * queue->item, queue->item);
+    queue->inicio = (queue->inicio + 1) % queue->tamanho;
+    queue->quantos--;
+    pthread_cond_broadcast(&queue->mudou);
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  return ok;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  pthread_mutex_lock(&queue->mutex);
+  UBaseType_t n = queue->quantos;
+  pthread_mutex_unlock(&queue->mutex);
+  return n;
+}
+
+/* Mutex */
+
+struct SemaphoreDefinition {
+  pthread_mutex_t mutex;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+  SemaphoreHandle_t s = malloc(sizeof *s);
+  pthread_mutex_init(&s->mutex, NULL);
+  return s;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+  pthread_mutex_destroy(&semaphore->mutex);
+  free(semaphore);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait) {
+  if (!wait) return !pthread_mutex_trylock(&semaphore->mutex);
+  if (portMAX_DELAY == wait) return !pthread_mutex_lock(&semaphore->mutex);
+  // pthread_mutex_timedlock só aceita CLOCK_REALTIME
+  struct timespec t;
+  clock_gettime(CLOCK_REALTIME, &t);
+  t.tv_sec += wait / 1000;
+  t.tv_nsec += (wait % 1000) * 1000000L;
+  if (t.tv_nsec >= 1000000000L) {
+    t.tv_sec++;
+    t.tv_nsec -= 1000000000L;
+  }
+  return !pthread_mutex_timedlock(&semaphore->mutex, &t);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  return !pthread_mutex_unlock(&semaphore->mutex);
+}
+
+/* Timers: uma thread por timer, que chama o callback quando o prazo vence */
+
+struct tmrTimerControl {
+  pthread_mutex_t mutex;
+  pthread_cond_t mudou;
+  TickType_t periodo;
+  void *id;
+  TimerCallbackFunction_t callback;
+  bool ativo;
+  struct timespec vence;
+};
+
+static void *thread_timer(void *arg) {
+  TimerHandle_t t = arg;
+  pthread_mutex_lock(&t->mutex);
+  for (;;) {
+    if (!t->ativo) {
+      pthread_cond_wait(&t->mudou, &t->mutex);
+      continue;
+    }
+    if (ETIMEDOUT != pthread_cond_timedwait(&t->mudou, &t->mutex, &t->vence)) continue;
+    t->ativo = false;
+    pthread_mutex_unlock(&t->mutex);
+    t->callback(t);
+    pthread_mutex_lock(&t->mutex);
+  }
+  return NULL;
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+                           void *id, TimerCallbackFunction_t callback) {
+  TimerHandle_t t = calloc(1, sizeof *t);
+  pthread_mutex_init(&t->mutex, NULL);
+  cond_init(&t->mudou);
+  t->periodo = period;
+  t->id = id;
+  t->callback = callback;
+  pthread_t thread;
+  pthread_create(&thread, NULL, thread_timer, t);
+  pthread_detach(thread);
+  return t;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t wait) {
+  pthread_mutex_lock(&timer->mutex);
+  timer->ativo = true;
+  timer->vence = prazo(timer->periodo);
+  pthread_cond_signal(&timer->mudou);
+  pthread_mutex_unlock(&timer->mutex);
+  return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait) {
+  pthread_mutex_lock(&timer->mutex);
+  timer->ativo = false;
+  pthread_cond_signal(&timer->mudou);
+  pthread_mutex_unlock(&timer->mutex);
+  return pdPASS;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer) { return timer->id; }
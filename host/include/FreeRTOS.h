@@ -0,0 +1,20 @@
+// Stub mínimo do FreeRTOS para compilar lib/FatFs_SPI no PC: as tarefas são
+// threads POSIX (ver host/freertos_pthread.c). Um tick é 1 ms.
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskIDLE_PRIORITY 0
+#define configMAX_PRIORITIES 8
+#define configASSERT(x) ((void)0)
@@ -0,0 +1,20 @@
+// Stub mínimo do Pico SDK para compilar lib/ssd1306.c no PC (ver host/)
+#pragma once
+#include "pico/stdlib.h"
+
+typedef struct { uint32_t ctrl; } dma_channel_config;
+enum dma_channel_transfer_size { DMA_SIZE_8, DMA_SIZE_16, DMA_SIZE_32 };
+
+int dma_claim_unused_channel(bool required);
+void dma_channel_unclaim(uint channel);
+dma_channel_config dma_channel_get_default_config(uint channel);
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size);
+void channel_config_set_dreq(dma_channel_config *c, uint dreq);
+void channel_config_set_read_increment(dma_channel_config *c, bool incr);
+void channel_config_set_write_increment(dma_channel_config *c, bool incr);
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger);
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger);
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger);
+bool dma_channel_is_busy(uint channel);
+void dma_channel_abort(uint channel);
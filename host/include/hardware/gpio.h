@@ -0,0 +1,10 @@
+// Stub mínimo do Pico SDK (ver host/): só os tipos usados em sd_card.h e spi.h
+#pragma once
+#include "pico/types.h"
+
+enum gpio_drive_strength {
+  GPIO_DRIVE_STRENGTH_2MA = 0,
+  GPIO_DRIVE_STRENGTH_4MA = 1,
+  GPIO_DRIVE_STRENGTH_8MA = 2,
+  GPIO_DRIVE_STRENGTH_12MA = 3
+};
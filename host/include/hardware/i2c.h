@@ -0,0 +1,23 @@
+// Stub mínimo do Pico SDK para compilar lib/ssd1306.c no PC (ver host/)
+#pragma once
+#include "pico/stdlib.h"
+
+typedef struct i2c_inst i2c_inst_t;
+typedef struct {
+  io_rw_32 enable, tar, data_cmd, dma_cr, status, txflr;
+  io_rw_32 intr_mask, intr_stat, clr_stop_det, clr_tx_abrt;
+} i2c_hw_t;
+
+#define i2c0 ((i2c_inst_t *)0)
+#define i2c1 ((i2c_inst_t *)1)
+#define I2C_IC_DATA_CMD_STOP_BITS 0x200u
+#define I2C_IC_DMA_CR_TDMAE_BITS 0x2u
+#define I2C_IC_INTR_MASK_M_TX_ABRT_BITS 0x40u
+#define I2C_IC_INTR_MASK_M_STOP_DET_BITS 0x200u
+#define I2C_IC_STATUS_ACTIVITY_BITS 0x1u
+#define I2C_IC_STATUS_MST_ACTIVITY_BITS 0x20u
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop);
+i2c_hw_t *i2c_get_hw(i2c_inst_t *i2c);
+uint i2c_get_dreq(i2c_inst_t *i2c, bool is_tx);
+uint i2c_hw_index(i2c_inst_t *i2c);
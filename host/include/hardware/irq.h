@@ -0,0 +1,9 @@
+// Stub mínimo do Pico SDK para compilar lib/ssd1306.c no PC (ver host/)
+#pragma once
+#include "pico/stdlib.h"
+
+typedef void (*irq_handler_t)(void);
+enum { I2C0_IRQ = 23, I2C1_IRQ = 24 };
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
@@ -0,0 +1,5 @@
+// Stub mínimo do Pico SDK (ver host/): só o tipo usado em spi.h
+#pragma once
+#include "pico/types.h"
+
+typedef struct spi_inst spi_inst_t;
@@ -0,0 +1,5 @@
+// Stub mínimo do Pico SDK (ver host/): só o tipo, o cartão simulado não o usa
+#pragma once
+#include "pico/types.h"
+
+typedef struct { uint32_t owner; } mutex_t;
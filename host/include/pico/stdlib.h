@@ -0,0 +1,6 @@
+// Stub mínimo do Pico SDK para compilar lib/ssd1306.c no PC (ver host/)
+#pragma once
+#include <stdio.h>
+#include "pico/types.h"
+
+void tight_loop_contents(void);
@@ -0,0 +1,11 @@
+// Stub mínimo do Pico SDK para compilar lib/ssd1306.c e lib/FatFs_SPI no PC
+// (ver host/)
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+typedef volatile uint32_t io_rw_32;
+
+#define __not_in_flash_func(func) func
@@ -0,0 +1,11 @@
+// Stub mínimo do FreeRTOS (ver host/include/FreeRTOS.h): só mutex
+#pragma once
+#include "FreeRTOS.h"
+#include "queue.h"
+
+typedef struct SemaphoreDefinition *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
@@ -0,0 +1,18 @@
+// Stub mínimo do FreeRTOS (ver host/include/FreeRTOS.h)
+#pragma once
+#include "FreeRTOS.h"
+
+typedef struct tskTaskControlBlock *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef enum { eNoAction, eSetBits, eIncrement, eSetValueWithOverwrite } eNotifyAction;
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stack_depth,
+                       void *parameters, UBaseType_t priority, TaskHandle_t *created_task);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit,
+                           uint32_t *value, TickType_t wait);
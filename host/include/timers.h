@@ -0,0 +1,13 @@
+// Stub mínimo do FreeRTOS (ver host/include/FreeRTOS.h): timers de disparo
+// único, o que basta para o combinador de escritas do glue.c
+#pragma once
+#include "FreeRTOS.h"
+
+typedef struct tmrTimerControl *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+                           void *id, TimerCallbackFunction_t callback);
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait);
+void *pvTimerGetTimerID(TimerHandle_t timer);
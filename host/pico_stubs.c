@@ -0,0 +1,36 @@
+// Implementação dos stubs de host/include: o I2C só conta as transações e
+// não há canal de DMA livre, então o ssd1306 usa sempre o envio bloqueante.
+#include "pico/stdlib.h"
+#include "hardware/i2c.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+
+long i2c_transactions, i2c_bytes;
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop) {
+  i2c_transactions++;
+  i2c_bytes += len;
+  return len;
+}
+i2c_hw_t *i2c_get_hw(i2c_inst_t *i2c) { return NULL; }
+uint i2c_get_dreq(i2c_inst_t *i2c, bool is_tx) { return 0; }
+uint i2c_hw_index(i2c_inst_t *i2c) { return (uintptr_t)i2c; }
+
+int dma_claim_unused_channel(bool required) { return -1; }
+void dma_channel_unclaim(uint channel) {}
+dma_channel_config dma_channel_get_default_config(uint channel) { return (dma_channel_config){0}; }
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {}
+void channel_config_set_dreq(dma_channel_config *c, uint dreq) {}
+void channel_config_set_read_increment(dma_channel_config *c, bool incr) {}
+void channel_config_set_write_increment(dma_channel_config *c, bool incr) {}
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {}
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger) {}
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger) {}
+bool dma_channel_is_busy(uint channel) { return false; }
+void dma_channel_abort(uint channel) {}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {}
+void irq_set_enabled(uint num, bool enabled) {}
+
+void tight_loop_contents(void) {}
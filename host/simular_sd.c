@@ -0,0 +1,286 @@
+// Simulador de cartão SD no PC para exercitar a API assíncrona
+// (lib/FatFs_SPI/include/sd_async.h) sobre o glue.c de verdade: o cartão é
+// um disco em RAM com tempos de comando e de transferência parecidos com os
+// do SPI a 20.8 MHz, e as tarefas do FreeRTOS são threads
+// (host/freertos_pthread.c).
+//
+//   L=lib/FatFs_SPI
+//   gcc -O2 -pthread -Ihost/include -I$L/ff15/source -I$L/sd_driver -I$L/include host/simular_sd.c host/freertos_pthread.c $L/src/glue.c $L/src/sd_async.c -o simular_sd
+//   ./simular_sd [rodadas] [blocos]
+//
+// Primeiro confere a coerência: pedidos assíncronos misturados com
+// disk_read/disk_write diretos de outra tarefa, tudo comparado com um modelo
+// do disco. Depois mede a gravação de blocos de 4 KiB com um produtor que
+// gasta tempo preparando cada bloco: síncrona (disk_write) e assíncrona.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "ff.h"
+#include "diskio.h"
+#include "hw_config.h"
+#include "sd_async.h"
+
+#define SETORES 131072  // 64 MiB
+#define SS 512
+
+/* Cartão simulado */
+
+static uint8_t *disco;
+static sd_card_t cartao;
+static long cmd_leitura, cmd_escrita, setores_lidos, setores_escritos;
+
+static void espera_us(unsigned us) {
+  struct timespec t = {us / 1000000, (us % 1000000) * 1000L};
+  nanosleep(&t, NULL);
+}
+
+static uint64_t agora_us(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000ull + t.tv_nsec / 1000;
+}
+
+static int sim_init(sd_card_t *p) {
+  p->m_Status &= ~STA_NOINIT;
+  return p->m_Status;
+}
+
+// Comando + 250 µs por setor no barramento; a escrita ainda espera o cartão
+// sair de ocupado
+static int sim_read(sd_card_t *p, uint8_t *b, uint64_t s, uint32_t n) {
+  if (s + n > SETORES) return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+  espera_us(100 + 250 * n);
+  memcpy(b, disco + s * SS, n * SS);
+  __atomic_add_fetch(&cmd_leitura, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&setores_lidos, n, __ATOMIC_RELAXED);
+  return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static int sim_write(sd_card_t *p, const uint8_t *b, uint64_t s, uint32_t n) {
+  if (s + n > SETORES) return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+  espera_us(600 + 250 * n);
+  memcpy(disco + s * SS, b, n * SS);
+  __atomic_add_fetch(&cmd_escrita, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&setores_escritos, n, __ATOMIC_RELAXED);
+  return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+// O que o glue.c e o sd_async.c pedem do resto do driver
+size_t sd_get_num() { return 1; }
+sd_card_t *sd_get_by_num(size_t num) { return num ? NULL : &cartao; }
+bool sd_init_driver() { return true; }
+bool sd_card_detect(sd_card_t *p) { return true; }
+uint64_t sd_sectors(sd_card_t *p) { return SETORES; }
+const sd_card_info_t *sd_card_info(sd_card_t *p) { return &p->info; }
+void my_printf(const char *fmt, ...) {}
+void my_assert_func(const char *file, int line, const char *func, const char *pred) { abort(); }
+
+/* Coerência */
+
+// Cada setor gravado carrega o próprio número e uma versão, então um dado
+// velho ou do setor errado aparece na comparação
+static void preenche(uint8_t *b, LBA_t setor, uint32_t versao) {
+  for (int i = 0; i < SS; i += 8) {
+    memcpy(b + i, &setor, 4);
+    memcpy(b + i + 4, &versao, 4);
+  }
+}
+
+#define REGIAO_A 1000  // Da tarefa principal, assíncrona e direta
+#define REGIAO_B 5000  // Da outra tarefa, só direta
+#define TAM_REGIAO 48
+
+static uint32_t modelo_a[TAM_REGIAO], modelo_b[TAM_REGIAO];
+static long erros;
+static volatile bool parar;
+
+static void confere(const uint8_t *b, LBA_t setor, uint32_t versao, const char *onde) {
+  uint8_t esperado[SS];
+  preenche(esperado, setor, versao);
+  if (memcmp(b, esperado, SS)) {
+    uint32_t lida;
+    memcpy(&lida, b + 4, 4);
+    if (erros++ < 10)
+      printf("  %s: setor %lu versão %u, esperada %u\n", onde, (unsigned long)setor, lida, versao);
+  }
+}
+
+// Outra tarefa usando o mesmo cartão pelo caminho do FatFs, ao mesmo tempo
+static void tarefa_direta(void *arg) {
+  uint8_t b[4 * SS];
+  uint32_t versao = 1;
+  while (!parar) {
+    UINT i = rand() % (TAM_REGIAO - 4), n = 1 + rand() % 4;
+    if (rand() % 2) {
+      for (UINT k = 0; k < n; ++k) {
+        modelo_b[i + k] = versao++;
+        preenche(b + k * SS, REGIAO_B + i + k, modelo_b[i + k]);
+      }
+      if (disk_write(0, b, REGIAO_B + i, n)) erros++;
+    } else {
+      if (disk_read(0, b, REGIAO_B + i, n)) erros++;
+      for (UINT k = 0; k < n; ++k)
+        if (modelo_b[i + k]) confere(b + k * SS, REGIAO_B + i + k, modelo_b[i + k], "direta B");
+    }
+  }
+  vTaskDelay(portMAX_DELAY);
+}
+
+#define BLOCO 8  // Setores por gravação na medida de vazão (4 KiB)
+
+typedef struct {
+  sd_async_req_t req;
+  uint8_t dados[BLOCO * SS];
+  uint32_t versoes[4];  // Para leituras: o que o modelo dizia na submissão
+  bool usado;
+} pedido_t;
+
+static void termina(pedido_t *p) {
+  if (!p->usado) return;
+  if (sd_async_wait(&p->req, portMAX_DELAY)) erros++;
+  if (SD_ASYNC_READ == p->req.op)
+    for (UINT k = 0; k < p->req.count; ++k)
+      if (p->versoes[k]) confere(p->dados + k * SS, p->req.sector + k, p->versoes[k], "assíncrona A");
+  p->usado = false;
+}
+
+static void testa_coerencia(int rodadas) {
+  static pedido_t pedidos[SD_ASYNC_QUEUE_DEPTH + 1];
+  uint32_t versao = 1u << 24;
+  uint8_t b[4 * SS];
+  TaskHandle_t outra;
+  xTaskCreate(tarefa_direta, "direta", 1024, NULL, 1, &outra);
+  int p = 0;
+  for (int r = 0; r < rodadas; ++r) {
+    pedido_t *ped = &pedidos[p];
+    p = (p + 1) % (SD_ASYNC_QUEUE_DEPTH + 1);
+    termina(ped);
+    UINT i = rand() % (TAM_REGIAO - 4), n = 1 + rand() % 4;
+    switch (rand() % 6) {
+      case 0:
+      case 1:  // Escrita assíncrona
+        for (UINT k = 0; k < n; ++k) {
+          modelo_a[i + k] = versao++;
+          preenche(ped->dados + k * SS, REGIAO_A + i + k, modelo_a[i + k]);
+        }
+        ped->req.notify_task = xTaskGetCurrentTaskHandle();
+        ped->usado = !sd_async_write(&cartao, &ped->req, ped->dados, REGIAO_A + i, n);
+        break;
+      case 2:
+      case 3:  // Leitura assíncrona: a fila é FIFO, vale o modelo de agora
+        memcpy(ped->versoes, &modelo_a[i], n * sizeof modelo_a[0]);
+        ped->req.notify_task = xTaskGetCurrentTaskHandle();
+        ped->usado = !sd_async_read(&cartao, &ped->req, ped->dados, REGIAO_A + i, n);
+        break;
+      case 4:  // Direta, depois de esvaziar a fila
+        for (int k = 0; k <= SD_ASYNC_QUEUE_DEPTH; ++k) termina(&pedidos[k]);
+        if (rand() % 2) {
+          for (UINT k = 0; k < n; ++k) {
+            modelo_a[i + k] = versao++;
+            preenche(b + k * SS, REGIAO_A + i + k, modelo_a[i + k]);
+          }
+          if (disk_write(0, b, REGIAO_A + i, n)) erros++;
+        } else {
+          if (disk_read(0, b, REGIAO_A + i, n)) erros++;
+          for (UINT k = 0; k < n; ++k)
+            if (modelo_a[i + k]) confere(b + k * SS, REGIAO_A + i + k, modelo_a[i + k], "direta A");
+        }
+        break;
+      default: {  // SD_ASYNC_SYNC e então o próprio cartão tem que bater
+        for (int k = 0; k <= SD_ASYNC_QUEUE_DEPTH; ++k) termina(&pedidos[k]);
+        sd_async_req_t sync = {.notify_task = xTaskGetCurrentTaskHandle()};
+        if (sd_async_sync(&cartao, &sync) || sd_async_wait(&sync, portMAX_DELAY)) erros++;
+        for (UINT k = 0; k < TAM_REGIAO; ++k)
+          if (modelo_a[k]) confere(disco + (REGIAO_A + k) * SS, REGIAO_A + k, modelo_a[k], "cartão A");
+      }
+    }
+  }
+  for (int k = 0; k <= SD_ASYNC_QUEUE_DEPTH; ++k) termina(&pedidos[k]);
+  parar = true;
+  vTaskDelay(50);
+  printf("coerência: %d rodadas, %ld erros\n", rodadas, erros);
+}
+
+/* Vazão */
+
+#define PREPARO_US 3000  // Produtor preparando o próximo bloco
+
+static void prepara(uint8_t *b, LBA_t setor) {
+  for (int k = 0; k < BLOCO; ++k) preenche(b + k * SS, setor + k, 7);
+  espera_us(PREPARO_US);
+}
+
+static void relata(const char *nome, int blocos, uint64_t total, uint64_t parado, long cmds) {
+  printf("%-11s %6.1f ms  %6.1f KiB/s  produtor parado %6.1f ms  %ld escritas no cartão\n",
+         nome, total / 1000.0, blocos * BLOCO * SS / 1024.0 / (total / 1e6), parado / 1000.0, cmds);
+}
+
+static void mede_vazao(int blocos) {
+  static uint8_t b[BLOCO * SS];
+  LBA_t base = 20000;
+  long cmds = cmd_escrita;
+  uint64_t parado = 0, t0 = agora_us();
+  for (int i = 0; i < blocos; ++i) {
+    prepara(b, base + i * BLOCO);
+    uint64_t t = agora_us();
+    if (disk_write(0, b, base + i * BLOCO, BLOCO)) erros++;
+    parado += agora_us() - t;
+  }
+  uint64_t t = agora_us();
+  if (disk_ioctl(0, CTRL_SYNC, NULL)) erros++;
+  parado += agora_us() - t;
+  relata("síncrona", blocos, agora_us() - t0, parado, cmd_escrita - cmds);
+
+  // Um buffer por pedido que pode estar na fila, mais o que está sendo
+  // preparado
+  static pedido_t pedidos[SD_ASYNC_QUEUE_DEPTH + 1];
+  base += blocos * BLOCO;
+  cmds = cmd_escrita;
+  parado = 0;
+  t0 = agora_us();
+  for (int i = 0; i < blocos; ++i) {
+    pedido_t *ped = &pedidos[i % (SD_ASYNC_QUEUE_DEPTH + 1)];
+    t = agora_us();
+    termina(ped);
+    parado += agora_us() - t;
+    prepara(ped->dados, base + i * BLOCO);
+    t = agora_us();
+    ped->req.notify_task = xTaskGetCurrentTaskHandle();
+    ped->usado = !sd_async_write(&cartao, &ped->req, ped->dados, base + i * BLOCO, BLOCO);
+    parado += agora_us() - t;
+  }
+  t = agora_us();
+  for (int k = 0; k <= SD_ASYNC_QUEUE_DEPTH; ++k) termina(&pedidos[k]);
+  sd_async_req_t sync = {.notify_task = xTaskGetCurrentTaskHandle()};
+  if (sd_async_sync(&cartao, &sync) || sd_async_wait(&sync, portMAX_DELAY)) erros++;
+  parado += agora_us() - t;
+  relata("assíncrona", blocos, agora_us() - t0, parado, cmd_escrita - cmds);
+
+  for (LBA_t s = 20000; s < base + blocos * BLOCO; ++s) confere(disco + s * SS, s, 7, "vazão");
+}
+
+int main(int argc, char **argv) {
+  int rodadas = argc > 1 ? atoi(argv[1]) : 20000, blocos = argc > 2 ? atoi(argv[2]) : 200;
+  srand(1);
+  disco = calloc(SETORES, SS);
+  cartao.pcName = "sd0";
+  cartao.m_Status = STA_NOINIT;
+  cartao.init = sim_init;
+  cartao.read_blocks = sim_read;
+  cartao.write_blocks = sim_write;
+  if (disk_initialize(0) & STA_NOINIT) return 1;
+  if (!sd_async_start(&cartao, tskIDLE_PRIORITY + 2)) return 2;
+  // Sem worker, submeter falha em vez de ir direto ao cartão
+  static sd_card_t outro;
+  sd_async_req_t req = {.count = 1};
+  if (SD_BLOCK_DEVICE_ERROR_NO_INIT != sd_async_submit(&outro, &req, 0)) erros++;
+
+  testa_coerencia(rodadas);
+  mede_vazao(blocos);
+  printf("cartão: %ld leituras (%ld setores), %ld escritas (%ld setores)\n", cmd_leitura,
+         setores_lidos, cmd_escrita, setores_escritos);
+  return erros ? 3 : 0;
+}
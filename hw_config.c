@@ -19,6 +19,7 @@ This example assumes the following hardware configuration:
 | MOSI  | TX    | 19    | 25    | DI        | DI        | Master Out, Slave In   |
 | SCK   | SCK   | 18    | 24    | SCLK      | CLK       | SPI clock              |
 | CS0   | CSn   | 17    | 22    | SS or CS  | CS        | Slave (or Chip) Select |
+| CS1   |       | 20    | 26    | SS or CS  | CS        | Second card's select   |
 | DET   |       | 22    | 29    |           | CD        | Card Detect            |
 | GND   |       |       | 18,23 |           | GND       | Ground                 |
 | 3v3   |       |       | 36    |           | 3v3       | 3.3 volt power         |
@@ -35,7 +36,9 @@ static spi_t spis[] = {  // One for each SPI.
         .mosi_gpio = 19,
         .sck_gpio = 18,
 
-        // .baud_rate = 1000 * 1000
+        // Starting point for the per-card baud rate negotiation in sd_init:
+        // the driver steps up from here, verifying reads with CRC, up to the
+        // card's limit (or sd_card_t::max_baud_rate).
         .baud_rate = 1000 * 1000
         // .baud_rate = 25 * 1000 * 1000 // Actual frequency: 20833333.
     }};
@@ -48,8 +51,20 @@ static sd_card_t sd_cards[] = {  // One for each SD card
         .ss_gpio = 17,    // The SPI slave select GPIO for this SD card
         .use_card_detect = false,
         .card_detect_gpio = 22,  // Card detect
-        .card_detected_true = -1  // What the GPIO read returns when a card is
+        .card_detected_true = -1,  // What the GPIO read returns when a card is
                                  // present.
+        .max_baud_rate = 0       // 0: 25 MHz, or 50 MHz in High-Speed mode
+    },
+    {
+        // Second card on the same SPI, for the striped log (log_storage.c).
+        // Optional: if it doesn't mount, logging uses card 0 alone.
+        .pcName = "1:",
+        .spi = &spis[0],
+        .ss_gpio = 20,
+        .use_card_detect = false,
+        .card_detect_gpio = 22,
+        .card_detected_true = -1,
+        .max_baud_rate = 0
     }};
 
 /* ********************************************************************** */
@@ -39,7 +39,7 @@ void ff_memfree (
 /* Definitions of Mutex                                                   */
 /*------------------------------------------------------------------------*/
 
-#define OS_TYPE	0	/* 0:Win32, 1:uITRON4.0, 2:uC/OS-II, 3:FreeRTOS, 4:CMSIS-RTOS */
+#define OS_TYPE	3	/* 0:Win32, 1:uITRON4.0, 2:uC/OS-II, 3:FreeRTOS, 4:CMSIS-RTOS */
 
 
 #if   OS_TYPE == 0	/* Win32 */
@@ -56,9 +56,14 @@ static mtxid Mutex[FF_VOLUMES + 1];		/* Table of mutex ID */
 static OS_EVENT *Mutex[FF_VOLUMES + 1];	/* Table of mutex pinter */
 
 #elif OS_TYPE == 3	/* FreeRTOS */
+#include <string.h>
 #include "FreeRTOS.h"
 #include "semphr.h"
+#include "task.h"
+#include "pico/time.h"
+#include "f_util.h"
 static SemaphoreHandle_t Mutex[FF_VOLUMES + 1];	/* Table of mutex handle */
+static ff_lock_stats_t Stats[FF_VOLUMES + 1];	/* Lock wait statistics (see f_util.h) */
 
 #elif OS_TYPE == 4	/* CMSIS-RTOS */
 #include "cmsis_os.h"
@@ -166,7 +171,30 @@ int ff_mutex_take (	/* Returns 1:Succeeded or 0:Timeout */
 	return (int)(err == OS_NO_ERR);
 
 #elif OS_TYPE == 3	/* FreeRTOS */
-	return (int)(xSemaphoreTake(Mutex[vol], FF_FS_TIMEOUT) == pdTRUE);
+	ff_lock_stats_t *st = &Stats[vol];
+	int rv;
+
+	/* The statistics are only updated with the mutex held, except for a
+	   timeout, which is counted in a critical section */
+	if (xSemaphoreTake(Mutex[vol], 0) == pdTRUE) {	/* Uncontended */
+		st->takes++;
+		return 1;
+	}
+	/* Somebody else holds it: wait, and time the wait */
+	uint32_t t0 = time_us_32();
+	rv = (int)(xSemaphoreTake(Mutex[vol], FF_FS_TIMEOUT) == pdTRUE);
+	uint32_t dt = time_us_32() - t0;
+	if (rv) {
+		st->takes++;
+		st->contended++;
+		st->wait_us_total += dt;
+		if (dt > st->wait_us_max) st->wait_us_max = dt;
+	} else {
+		taskENTER_CRITICAL();
+		st->timeouts++;
+		taskEXIT_CRITICAL();
+	}
+	return rv;
 
 #elif OS_TYPE == 4	/* CMSIS-RTOS */
 	return (int)(osMutexWait(Mutex[vol], FF_FS_TIMEOUT) == osOK);
@@ -204,5 +232,35 @@ void ff_mutex_give (
 #endif
 }
 
+#if OS_TYPE == 3	/* FreeRTOS */
+
+/*------------------------------------------------------------------------*/
+/* Lock Wait Statistics                                                   */
+/*------------------------------------------------------------------------*/
+
+void ff_lock_stats (
+	int vol,				/* Volume (0 to FF_VOLUMES - 1) or system lock (FF_VOLUMES) */
+	ff_lock_stats_t* stats	/* Copy of the statistics */
+)
+{
+	if (vol < 0 || vol > FF_VOLUMES) return;
+	taskENTER_CRITICAL();
+	*stats = Stats[vol];
+	taskEXIT_CRITICAL();
+}
+
+
+void ff_lock_stats_reset (
+	int vol					/* Volume (0 to FF_VOLUMES - 1) or system lock (FF_VOLUMES) */
+)
+{
+	if (vol < 0 || vol > FF_VOLUMES) return;
+	taskENTER_CRITICAL();
+	memset(&Stats[vol], 0, sizeof Stats[vol]);
+	taskEXIT_CRITICAL();
+}
+
+#endif
+
 #endif	/* FF_FS_REENTRANT */
 
@@ -24,6 +24,20 @@ extern "C" {
         UINT sz_buff,   /* Size of path name buffer (items) */
         FILINFO* fno    /* Name read buffer */
     );
+    FRESULT f_mkfs_for_logging(const TCHAR *path);
+
+    /* Volume lock wait statistics, kept by ff_mutex_take (ffsystem.c) */
+    typedef struct {
+        uint32_t takes;          /* Lock acquisitions */
+        uint32_t contended;      /* Acquisitions that had to wait */
+        uint32_t timeouts;       /* Waits that gave up (FR_TIMEOUT) */
+        uint32_t wait_us_max;
+        uint64_t wait_us_total;  /* Divide by contended for the mean wait */
+    } ff_lock_stats_t;
+    void ff_lock_stats(int vol, ff_lock_stats_t *stats);
+    void ff_lock_stats_reset(int vol);
+    void ff_lock_stats_print(int vol);
+    void ff_lock_contention_bench(const TCHAR *drive, UINT writers, UINT seconds);
 
 #ifdef __cplusplus
 }
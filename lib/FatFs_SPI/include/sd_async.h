@@ -0,0 +1,97 @@
+// Asynchronous (non-blocking) block device requests.
+//
+// Each SD card gets a small request queue and a worker task that drains it.
+// The submitter hands over a request and goes on with its work; the worker
+// runs the transfers back-to-back and reports completion through a callback
+// and/or a task notification. The request itself is the handle: it is owned
+// by the caller and must stay valid until it completes.
+//
+// Requests go through disk_read/disk_write/disk_ioctl (glue.c), under the
+// drive's mutex, so they see and update the same write combiner, sector
+// cache and read-ahead window as FatFs. A completed write may still be
+// deferred in the combiner: submit an SD_ASYNC_SYNC to get it onto the card.
+// The card must have been initialized (disk_initialize) first.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+//
+#include "FreeRTOS.h"
+#include "task.h"
+//
+#include "ff.h"
+#include "diskio.h"
+#include "sd_card.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SD_ASYNC_QUEUE_DEPTH
+#define SD_ASYNC_QUEUE_DEPTH 4 /*!< Outstanding requests per card */
+#endif
+#ifndef SD_ASYNC_STACK_SIZE
+#define SD_ASYNC_STACK_SIZE 1024 /*!< Worker task stack, in words */
+#endif
+
+typedef enum {
+    SD_ASYNC_READ,
+    SD_ASYNC_WRITE,
+    SD_ASYNC_SYNC  // disk_ioctl(CTRL_SYNC); buffer, sector and count unused
+} sd_async_op_t;
+
+typedef struct sd_async_req_t sd_async_req_t;
+
+// Called from the card's worker task when a request completes, before done
+// is set. Keep it short: the next queued request waits for it.
+typedef void (*sd_async_callback_t)(sd_async_req_t *req_p);
+
+struct sd_async_req_t {
+    // Filled in by the caller:
+    sd_async_op_t op;
+    uint8_t *buffer;              // Source for writes, destination for reads
+    LBA_t sector;                 // Starting LBA
+    UINT count;                   // Number of sectors
+    sd_async_callback_t callback; // May be NULL
+    void *context;                // For the caller's use
+    TaskHandle_t notify_task;     // Given a notification on completion; may be NULL
+
+    // Filled in by the driver:
+    sd_card_t *sd_card_p;
+    volatile DRESULT status;      // From disk_read/disk_write/disk_ioctl
+    volatile bool done;
+};
+
+bool sd_async_start(sd_card_t *sd_card_p, UBaseType_t priority);
+int sd_async_submit(sd_card_t *sd_card_p, sd_async_req_t *req_p, TickType_t wait);
+DRESULT sd_async_wait(sd_async_req_t *req_p, TickType_t timeout);
+size_t sd_async_pending(sd_card_t *sd_card_p);
+
+static inline int sd_async_write(sd_card_t *sd_card_p, sd_async_req_t *req_p,
+                                 const uint8_t *buffer, LBA_t sector,
+                                 UINT count) {
+    req_p->op = SD_ASYNC_WRITE;
+    req_p->buffer = (uint8_t *)buffer;
+    req_p->sector = sector;
+    req_p->count = count;
+    return sd_async_submit(sd_card_p, req_p, portMAX_DELAY);
+}
+static inline int sd_async_read(sd_card_t *sd_card_p, sd_async_req_t *req_p,
+                                uint8_t *buffer, LBA_t sector, UINT count) {
+    req_p->op = SD_ASYNC_READ;
+    req_p->buffer = buffer;
+    req_p->sector = sector;
+    req_p->count = count;
+    return sd_async_submit(sd_card_p, req_p, portMAX_DELAY);
+}
+static inline int sd_async_sync(sd_card_t *sd_card_p, sd_async_req_t *req_p) {
+    req_p->op = SD_ASYNC_SYNC;
+    return sd_async_submit(sd_card_p, req_p, portMAX_DELAY);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -165,11 +165,15 @@ specific language governing permissions and limitations under the License.
 //
 #include "pico/mutex.h"
 //
+#include "FreeRTOS.h"
+#include "task.h"
+//
 #include "hw_config.h"  // Hardware Configuration of the SPI and SD Card "objects"
 #include "my_debug.h"
 #include "sd_spi.h"
 //
 #include "sd_card.h"
+#include "sd_trace.h"
 //
 #include "ff.h" /* Obtains integer types */
 //
@@ -326,14 +330,17 @@ static uint8_t sd_cmd_spi(sd_card_t *pSD, cmdSupported cmd, uint32_t arg) {
         }
     }
     // send a command
-    for (int i = 0; i < PACKET_SIZE; i++) {
-        sd_spi_write(pSD, cmdPacket[i]);
-    }
+    spi_sg_list_t frame;
+    spi_sg_init(&frame);
+    spi_sg_append(pSD->spi, &frame, (uint8_t *)cmdPacket, PACKET_SIZE);
     // The received byte immediataly following CMD12 is a stuff byte,
     // it should be discarded before receive the response of the CMD12.
     if (CMD12_STOP_TRANSMISSION == cmd) {
-        sd_spi_write(pSD, SPI_FILL_CHAR);
+        spi_sg_append(pSD->spi, &frame, NULL, 1);
     }
+    sd_spi_sg_start(pSD, &frame);
+    bool ok = sd_spi_sg_wait(pSD, NULL);
+    myASSERT(ok);
     // Loop for response: Response is sent back within command response time
     // (NCR), 0 to 8 bytes for SDC
     for (int i = 0; i < 0x10; i++) {
@@ -363,6 +370,61 @@ static bool sd_wait_ready(sd_card_t *pSD, int timeout) {
     return (resp > 0x00);
 }
 
+/* Sleep, letting other tasks run once the scheduler is up. Card init can
+   take seconds, and is often run from a low priority task. */
+static void sd_sleep_ms(uint32_t ms) {
+    if (taskSCHEDULER_RUNNING == xTaskGetSchedulerState()) {
+        TickType_t ticks = pdMS_TO_TICKS(ms);
+        vTaskDelay(ticks ? ticks : 1);
+    } else {
+        busy_wait_us(ms * 1000);
+    }
+}
+
+#ifndef SD_SHARED_POLL_US
+#define SD_SHARED_POLL_US 50 /*!< Busy poll period with the SPI released */
+#endif
+
+/* Is another initialized card on pSD's SPI? Cards that are declared in
+   hw_config.c but absent, or not mounted yet, don't count. */
+static bool sd_bus_shared(sd_card_t *pSD) {
+    for (size_t i = 0; i < sd_get_num(); ++i) {
+        sd_card_t *other = sd_get_by_num(i);
+        if (other != pSD && other->spi == pSD->spi &&
+            !(other->m_Status & STA_NOINIT))
+            return true;
+    }
+    return false;
+}
+
+/* Wait for the card to finish programming without holding the SPI, so other
+   cards on the bus can transfer meanwhile. A card keeps programming with CS
+   deasserted, and shows busy again (DO low) when it's reselected. With no
+   other card initialized on the SPI there's nobody to hand the bus to: just
+   poll. Programming a block takes a few hundred us, so the bus is offered
+   with a yield every SD_SHARED_POLL_US rather than a whole tick's sleep. A
+   task waiting for the SPI mutex is made ready when it's released; if it's
+   of lower priority it only gets the bus once this task blocks. */
+static bool sd_wait_ready_shared(sd_card_t *pSD, int timeout) {
+    if (!sd_bus_shared(pSD)) return sd_wait_ready(pSD, timeout);
+
+    absolute_time_t timeout_time = make_timeout_time_ms(timeout);
+    for (;;) {
+        uint8_t resp;
+        sd_spi_read_polled(pSD, &resp, 1);
+        if (resp) return true;
+        if (0 >= absolute_time_diff_us(get_absolute_time(), timeout_time)) {
+            DBG_PRINTF("%s failed\r\n", __FUNCTION__);
+            return false;
+        }
+        sd_spi_release(pSD);
+        if (taskSCHEDULER_RUNNING == xTaskGetSchedulerState())
+            taskYIELD();
+        busy_wait_us(SD_SHARED_POLL_US);
+        sd_spi_acquire(pSD);
+    }
+}
+
 // An SD card can only do one thing at a time.
 static void sd_lock(sd_card_t *pSD) {
     myASSERT(mutex_is_initialized(&pSD->mutex));
@@ -450,8 +512,14 @@ static const char *cmd2str(const cmdSupported cmd) {
 #define SD_COMMAND_RETRIES 3 /*!< Times SPI cmd is retried when there is no response */
 #define SD_COMMAND_TIMEOUT 2000 /*!< Timeout in ms for response */
 
-static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
-                  bool isAcmd, uint32_t *resp) {
+static uint16_t us_since(uint32_t start_us) {
+    uint32_t us = time_us_32() - start_us;
+    return us > UINT16_MAX ? UINT16_MAX : us;
+}
+
+static int sd_cmd_untraced(sd_card_t *pSD, const cmdSupported cmd,
+                           uint32_t arg, bool isAcmd, uint32_t *resp,
+                           sd_trace_entry_t *trace_p) {
     TRACE_PRINTF("%s(%s(0x%08lx)): ", __FUNCTION__, cmd2str(cmd), arg);
 
     int32_t status = SD_BLOCK_DEVICE_ERROR_NONE;
@@ -459,12 +527,15 @@ static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
 
     // No need to wait for card to be ready when sending the stop command
     if (CMD12_STOP_TRANSMISSION != cmd) {
+        uint32_t busy_start = time_us_32();
         if (false == sd_wait_ready(pSD, SD_COMMAND_TIMEOUT)) {
             DBG_PRINTF("%s:%d: Card not ready yet\r\n", __FILE__, __LINE__);
         }
+        trace_p->busy_us = us_since(busy_start);
     }
     // Re-try command
-    for (int i = 0; i < SD_COMMAND_RETRIES; i++) {
+    int i;
+    for (i = 0; i < SD_COMMAND_RETRIES; i++) {
         // Send CMD55 for APP command first
         if (isAcmd) {
             response = sd_cmd_spi(pSD, CMD55_APP_CMD, 0x0);
@@ -481,6 +552,8 @@ static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
         }
         break;
     }
+    trace_p->retries = i;
+    trace_p->status = R1_NO_RESPONSE == response ? SD_TRACE_NO_STATUS : response;
     // Pass the response to the command call if required
     if (NULL != resp) {
         *resp = response;
@@ -531,9 +604,13 @@ static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
             DBG_PRINTF("R3/R7: 0x%" PRIx32 "\r\n", response);
             break;
         case CMD12_STOP_TRANSMISSION:  // Response R1b
-        case CMD38_ERASE:
+        case CMD38_ERASE: {
+            uint32_t busy_start = time_us_32();
             sd_wait_ready(pSD, SD_COMMAND_TIMEOUT);
+            uint32_t busy = trace_p->busy_us + us_since(busy_start);
+            trace_p->busy_us = busy > UINT16_MAX ? UINT16_MAX : busy;
             break;
+        }
         case CMD13_SEND_STATUS:  // Response R2
             response <<= 8;
             response |= sd_spi_write(pSD, SPI_FILL_CHAR);
@@ -611,6 +688,32 @@ static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
     return status;
 }
 
+#if SD_TRACE_ENABLED
+static uint8_t sd_card_index(sd_card_t *pSD) {
+    for (size_t i = 0; i < sd_get_num(); ++i)
+        if (sd_get_by_num(i) == pSD) return i;
+    return 0xFF;
+}
+#endif
+
+/* Send a command, recording it in the trace ring (sd_trace.h) */
+static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
+                  bool isAcmd, uint32_t *resp) {
+    sd_trace_entry_t trace = {
+        .start_us = time_us_32(),
+        .arg = arg,
+        .cmd = cmd | (isAcmd ? SD_TRACE_ACMD : 0),
+        .status = SD_TRACE_NO_STATUS};
+    int status = sd_cmd_untraced(pSD, cmd, arg, isAcmd, resp, &trace);
+#if SD_TRACE_ENABLED
+    trace.end_us = time_us_32();
+    trace.card = sd_card_index(pSD);
+    trace.error = -status;
+    sd_trace_record(&trace);
+#endif
+    return status;
+}
+
 /* Return non-zero if the SD-card is present. */
 bool sd_card_detect(sd_card_t *pSD) {
     TRACE_PRINTF("> %s\r\n", __FUNCTION__);
@@ -628,6 +731,7 @@ bool sd_card_detect(sd_card_t *pSD) {
         // The socket is now empty
         pSD->m_Status |= (STA_NODISK | STA_NOINIT);
         pSD->card_type = SDCARD_NONE;
+        pSD->info.valid = false;
         printf("No SD card detected!\r\n");
         return false;
     }
@@ -650,7 +754,7 @@ static uint32_t sd_go_idle_state(sd_card_t *pSD) {
             break;
         }
         sd_release(pSD);
-        busy_wait_us(100 * 1000);
+        sd_sleep_ms(100);
         sd_acquire(pSD);
     }
     return response;
@@ -682,37 +786,36 @@ static int sd_cmd8(sd_card_t *pSD) {
     return status;
 }
 
-static uint32_t ext_bits(unsigned char *data, int msb, int lsb) {
+// Extract bits [msb:lsb] from a big-endian register of data_size bytes
+static uint32_t ext_bits_n(unsigned char *data, uint32_t data_size, int msb,
+                           int lsb) {
     uint32_t bits = 0;
     uint32_t size = 1 + msb - lsb;
     for (uint32_t i = 0; i < size; i++) {
         uint32_t position = lsb + i;
-        uint32_t byte = 15 - (position >> 3);
+        uint32_t byte = data_size - 1 - (position >> 3);
         uint32_t bit = position & 0x7;
         uint32_t value = (data[byte] >> bit) & 1;
         bits |= value << i;
     }
     return bits;
 }
+static uint32_t ext_bits(unsigned char *data, int msb, int lsb) {
+    return ext_bits_n(data, 16, msb, lsb);
+}
 
 static int sd_read_bytes(sd_card_t *pSD, uint8_t *buffer, uint32_t length);
 
-static uint64_t sd_sectors_nolock(sd_card_t *pSD) {
+/* SD Status (ACMD13) is a 512-bit data block */
+#define SD_STATUS_SIZE 64
+
+/* Capacity in sectors, decoded from a CSD */
+static uint64_t csd_sectors(uint8_t *csd) {
     uint32_t c_size, c_size_mult, read_bl_len;
     uint32_t block_len, mult, blocknr;
     uint32_t hc_c_size;
     uint64_t blocks = 0, capacity = 0;
 
-    // CMD9, Response R2 (R1 byte + 16-byte block read)
-    if (sd_cmd(pSD, CMD9_SEND_CSD, 0x0, false, 0) != 0x0) {
-        DBG_PRINTF("Didn't get a response from the disk\r\n");
-        return 0;
-    }
-    uint8_t csd[16];
-    if (sd_read_bytes(pSD, csd, 16) != 0) {
-        DBG_PRINTF("Couldn't read csd response from disk\r\n");
-        return 0;
-    }
     // csd_structure : csd[127:126]
     int csd_structure = ext_bits(csd, 127, 126);
     switch (csd_structure) {
@@ -752,11 +855,137 @@ static uint64_t sd_sectors_nolock(sd_card_t *pSD) {
     };
     return blocks;
 }
+
+/* Read a register that the card sends as a data block (CSD, CID, SCR, SD
+   Status) */
+static int sd_read_register(sd_card_t *pSD, cmdSupported cmd, bool isAcmd,
+                            uint8_t *buffer, uint32_t length) {
+    int rc = sd_cmd(pSD, cmd, 0x0, isAcmd, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) {
+        DBG_PRINTF("Didn't get a response from the disk\r\n");
+        return rc;
+    }
+    rc = sd_read_bytes(pSD, buffer, length);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc)
+        DBG_PRINTF("Couldn't read CMD%d response from disk\r\n", cmd);
+    return rc;
+}
+
+/* Read the registers that don't need the card at full speed: OCR, CSD and
+   CID. Fills in the capacity. */
+static int sd_read_card_ids(sd_card_t *pSD) {
+    sd_card_info_t *info_p = &pSD->info;
+    uint32_t ocr;
+
+    int rc = sd_cmd(pSD, CMD58_READ_OCR, 0x0, false, &ocr);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+    info_p->ocr = ocr;
+
+    // CMD9, Response R2 (R1 byte + 16-byte block read)
+    rc = sd_read_register(pSD, CMD9_SEND_CSD, false, info_p->csd,
+                          sizeof info_p->csd);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+    info_p->sectors = csd_sectors(info_p->csd);
+    if (!info_p->sectors) return SD_BLOCK_DEVICE_ERROR_UNUSABLE;
+
+    rc = sd_read_register(pSD, CMD10_SEND_CID, false, info_p->cid,
+                          sizeof info_p->cid);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+    uint8_t *cid = info_p->cid;
+    info_p->manufacturer_id = ext_bits(cid, 127, 120);  // MID: [127:120]
+    memcpy(info_p->oem_id, &cid[1], 2);                // OID: [119:104]
+    info_p->oem_id[2] = 0;
+    memcpy(info_p->product_name, &cid[3], 5);          // PNM: [103:64]
+    info_p->product_name[5] = 0;
+    info_p->product_rev = ext_bits(cid, 63, 56);        // PRV: [63:56]
+    info_p->serial_number = ext_bits(cid, 55, 24);      // PSN: [55:24]
+    info_p->mfg_year = 2000 + ext_bits(cid, 19, 12);    // MDT: [19:8]
+    info_p->mfg_month = ext_bits(cid, 11, 8);
+    DBG_PRINTF("Card: %s rev %u.%u, serial 0x%08lx, %02u/%u\r\n",
+               info_p->product_name, info_p->product_rev >> 4,
+               info_p->product_rev & 0xF,
+               (unsigned long)info_p->serial_number, info_p->mfg_month,
+               info_p->mfg_year);
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+/* Read the SCR and SD Status */
+static int sd_read_card_status(sd_card_t *pSD) {
+    // AU_SIZE code to size in KiB
+    static const uint16_t au_kib[16] = {0,    16,   32,    64,    128,   256,
+                                        512,  1024, 2048,  4096,  8192,  12288,
+                                        16384, 24576, 32768, 65535};
+    static const uint8_t speed_classes[] = {0, 2, 4, 6, 10};
+    sd_card_info_t *info_p = &pSD->info;
+
+    int rc = sd_read_register(pSD, ACMD51_SEND_SCR, true, info_p->scr,
+                              sizeof info_p->scr);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+    uint8_t *scr = info_p->scr;
+    // SD_SPEC: [59:56], SD_SPEC3: [47], SD_SPEC4: [42], SD_SPECX: [41:38]
+    uint32_t spec = ext_bits_n(scr, sizeof info_p->scr, 59, 56);
+    uint32_t specx = ext_bits_n(scr, sizeof info_p->scr, 41, 38);
+    if (specx)
+        info_p->sd_spec = 4 + specx;
+    else if (ext_bits_n(scr, sizeof info_p->scr, 42, 42))
+        info_p->sd_spec = 4;
+    else if (ext_bits_n(scr, sizeof info_p->scr, 47, 47))
+        info_p->sd_spec = 3;
+    else
+        info_p->sd_spec = spec < 2 ? 1 : 2;
+
+    // ACMD13 has an R2 response followed by the data block
+    uint8_t *status = info_p->sd_status;
+    rc = sd_read_register(pSD, ACMD13_SD_STATUS, true, status,
+                          sizeof info_p->sd_status);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) {
+        memset(status, 0, sizeof info_p->sd_status);
+        return rc;
+    }
+    // SPEED_CLASS: [447:440]
+    uint32_t speed_class = ext_bits_n(status, SD_STATUS_SIZE, 447, 440);
+    if (speed_class < count_of(speed_classes))
+        info_p->speed_class = speed_classes[speed_class];
+    // UHS_SPEED_GRADE: [399:396]; VIDEO_SPEED_CLASS: [391:384]
+    info_p->uhs_speed_grade = ext_bits_n(status, SD_STATUS_SIZE, 399, 396);
+    info_p->video_speed_class = ext_bits_n(status, SD_STATUS_SIZE, 391, 384);
+    // AU_SIZE: [431:428]
+    uint32_t au_code = ext_bits_n(status, SD_STATUS_SIZE, 431, 428);
+    if (15 == au_code)
+        info_p->au_sectors = 64 * 1024 * 2;  // 64 MiB; doesn't fit in the table
+    else
+        info_p->au_sectors = au_kib[au_code] * 2;
+    DBG_PRINTF("Class %u, U%u, V%u, AU size: %lu sectors\r\n",
+               info_p->speed_class, info_p->uhs_speed_grade,
+               info_p->video_speed_class, (unsigned long)info_p->au_sectors);
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+/* Capacity in sectors, from the CSD read at initialization; 0 if the card
+   isn't initialized */
 uint64_t sd_sectors(sd_card_t *pSD) {
-    sd_acquire(pSD);
-    uint64_t sectors = sd_sectors_nolock(pSD);
-    sd_release(pSD);
-    return sectors;
+    return pSD->info.valid ? pSD->info.sectors : 0;
+}
+
+/* Registers and decoded card information, read at initialization.
+   Returns NULL if the card isn't initialized. No bus traffic. */
+const sd_card_info_t *sd_card_info(sd_card_t *pSD) {
+    return pSD->info.valid ? &pSD->info : NULL;
+}
+
+/* Print the write and sector cache statistics. Counters are cumulative
+   since boot. */
+void sd_card_stats_print(sd_card_t *pSD) {
+    printf("%s: %lu write commands, %lu sectors written (%.2f per command)\n",
+           pSD->pcName, (unsigned long)pSD->write_commands,
+           (unsigned long)pSD->sectors_written,
+           pSD->write_commands ? (double)pSD->sectors_written / pSD->write_commands : 0.0);
+    uint32_t lookups = pSD->cache_hits + pSD->cache_misses;
+    printf("%s: sector cache %lu hits, %lu misses (%lu%% hits), %lu write-backs\n",
+           pSD->pcName, (unsigned long)pSD->cache_hits,
+           (unsigned long)pSD->cache_misses,
+           lookups ? (unsigned long)(100ULL * pSD->cache_hits / lookups) : 0UL,
+           (unsigned long)pSD->cache_write_backs);
 }
 
 // SPI function to wait till chip is ready and sends start token
@@ -766,7 +995,9 @@ static bool sd_wait_token(sd_card_t *pSD, uint8_t token) {
     const uint32_t timeout = SD_COMMAND_TIMEOUT;  // Wait for start token
     absolute_time_t timeout_time = make_timeout_time_ms(timeout);
     do {
-        if (token == sd_spi_write(pSD, SPI_FILL_CHAR)) {
+        uint8_t response;
+        sd_spi_read_polled(pSD, &response, 1);
+        if (token == response) {
             return true;
         }
     } while (0 < absolute_time_diff_us(get_absolute_time(), timeout_time));
@@ -843,6 +1074,63 @@ static int sd_read_block(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
     return SD_BLOCK_DEVICE_ERROR_NONE;
 }
 
+#if SD_CRC_ENABLED
+static int sd_check_block_crc(uint8_t *buffer, uint16_t crc) {
+    if (!crc_on) return SD_BLOCK_DEVICE_ERROR_NONE;
+    uint16_t crc_result = crc16((void *)buffer, _block_size);
+    if (crc_result != crc) {
+        DBG_PRINTF("%s: Invalid CRC received 0x%" PRIx16
+                   " result of computation 0x%" PRIx16 "\r\n",
+                   __FUNCTION__, crc, crc_result);
+        return SD_BLOCK_DEVICE_ERROR_CRC;
+    }
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+#endif
+
+/* Receive the data blocks of a CMD18, overlapping the work on consecutive
+   blocks: as soon as block N+1's start token arrives its DMA is started, and
+   block N's CRC is checked while the data is clocked in. The token and CRC
+   bytes are polled rather than DMA'd. */
+static int sd_read_block_stream(sd_card_t *pSD, uint8_t *buffer,
+                                uint32_t blockCnt) {
+    uint8_t *unchecked = NULL;  // Block whose CRC hasn't been checked yet
+    uint16_t unchecked_crc = 0;
+    int status = SD_BLOCK_DEVICE_ERROR_NONE;
+
+    while (blockCnt) {
+        // read until start byte (0xFE)
+        if (false == sd_wait_token(pSD, SPI_START_BLOCK)) {
+            DBG_PRINTF("%s:%d Read timeout\r\n", __FILE__, __LINE__);
+            status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+            break;
+        }
+        sd_spi_transfer_start(pSD, NULL, buffer, _block_size);
+#if SD_CRC_ENABLED
+        if (unchecked) {
+            status = sd_check_block_crc(unchecked, unchecked_crc);
+            unchecked = NULL;
+        }
+#endif
+        if (!sd_spi_transfer_wait(pSD)) {
+            status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+        }
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) break;
+        // Read the CRC16 checksum for the data block
+        uint8_t crc[2];
+        sd_spi_read_polled(pSD, crc, sizeof crc);
+        unchecked_crc = crc[0] << 8 | crc[1];
+        unchecked = buffer;
+        buffer += _block_size;
+        --blockCnt;
+    }
+#if SD_CRC_ENABLED
+    if (unchecked && SD_BLOCK_DEVICE_ERROR_NONE == status)
+        status = sd_check_block_crc(unchecked, unchecked_crc);
+#endif
+    return status;
+}
+
 static int in_sd_read_blocks(sd_card_t *pSD, uint8_t *buffer,
                              uint64_t ulSectorNumber, uint32_t ulSectorCount) {
     uint32_t blockCnt = ulSectorCount;
@@ -871,16 +1159,12 @@ static int in_sd_read_blocks(sd_card_t *pSD, uint8_t *buffer,
     if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
         return status;
     }
-    // receive the data : one block at a time
-    int rd_status = 0;
-    while (blockCnt) {
-        if (0 != sd_read_block(pSD, buffer, _block_size)) {
-            rd_status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
-            break;
-        }
-        buffer += _block_size;
-        --blockCnt;
-    }
+    // receive the data
+    int rd_status;
+    if (blockCnt > 1)
+        rd_status = sd_read_block_stream(pSD, buffer, blockCnt);
+    else
+        rd_status = sd_read_block(pSD, buffer, _block_size);
     // Send CMD12(0x00000000) to stop the transmission for multi-block transfer
     if (ulSectorCount > 1) {
         status = sd_cmd(pSD, CMD12_STOP_TRANSMISSION, 0x0, false, 0);
@@ -898,39 +1182,67 @@ int sd_read_blocks(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
     return status;
 }
 
-static uint8_t sd_write_block(sd_card_t *pSD, const uint8_t *buffer,
-                              uint8_t token, uint32_t length) {
+static uint16_t sd_block_crc(const uint8_t *buffer, uint32_t length) {
     uint16_t crc = (~0);
-    uint8_t response = 0xFF;
-
-    // indicate start of block
-    sd_spi_write(pSD, token);
-
-    // write the data
-    bool ret = sd_spi_transfer(pSD, buffer, NULL, length);
-    myASSERT(ret);
-
 #if SD_CRC_ENABLED
     if (crc_on) {
         // Compute CRC
         crc = crc16((void *)buffer, length);
     }
 #endif
+    return crc;
+}
 
-    // write the checksum CRC16
-    sd_spi_write(pSD, crc >> 8);
-    sd_spi_write(pSD, crc);
+// A data block as it goes on the wire
+typedef struct {
+    spi_sg_list_t sg;
+    uint8_t token;
+    uint8_t crc[2];
+} sd_data_frame_t;
+
+/* Start sending a data block: start token, data, CRC16, and one more byte to
+   clock in the data response token. All in one chained DMA transfer. */
+static void sd_write_block_start(sd_card_t *pSD, sd_data_frame_t *frame_p,
+                                 const uint8_t *buffer, uint8_t token,
+                                 uint16_t crc, uint32_t length) {
+    frame_p->token = token;
+    frame_p->crc[0] = crc >> 8;
+    frame_p->crc[1] = crc;
+    spi_sg_init(&frame_p->sg);
+    spi_sg_append(pSD->spi, &frame_p->sg, &frame_p->token, 1);
+    spi_sg_append(pSD->spi, &frame_p->sg, buffer, length);
+    spi_sg_append(pSD->spi, &frame_p->sg, frame_p->crc, sizeof frame_p->crc);
+    spi_sg_append(pSD->spi, &frame_p->sg, NULL, 1);
+    sd_spi_sg_start(pSD, &frame_p->sg);
+}
+
+/* Wait for the block to go out, then for the card to program it.
+   share_bus: let other cards use the SPI while this one is busy. */
+static uint8_t sd_write_block_finish(sd_card_t *pSD, sd_data_frame_t *frame_p,
+                                     bool share_bus) {
+    uint8_t response = 0xFF;
 
     // check the response token
-    response = sd_spi_write(pSD, SPI_FILL_CHAR);
+    bool ret = sd_spi_sg_wait(pSD, &response);
+    myASSERT(ret);
 
     // Wait for last block to be written
-    if (false == sd_wait_ready(pSD, SD_COMMAND_TIMEOUT)) {
+    bool ready = share_bus ? sd_wait_ready_shared(pSD, SD_COMMAND_TIMEOUT)
+                           : sd_wait_ready(pSD, SD_COMMAND_TIMEOUT);
+    if (false == ready) {
         DBG_PRINTF("%s:%d: Card not ready yet\r\n", __FILE__, __LINE__);
     }
     return (response & SPI_DATA_RESPONSE_MASK);
 }
 
+static uint8_t sd_write_block(sd_card_t *pSD, const uint8_t *buffer,
+                              uint8_t token, uint32_t length) {
+    sd_data_frame_t frame;
+    sd_write_block_start(pSD, &frame, buffer, token,
+                         sd_block_crc(buffer, length), length);
+    return sd_write_block_finish(pSD, &frame, true);
+}
+
 /** Program blocks to a block device
  *
  *
@@ -957,6 +1269,9 @@ static int in_sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
     uint8_t response;
     uint64_t addr;
 
+    ++pSD->write_commands;
+    pSD->sectors_written += blockCnt;
+
     // SDSC Card (CCS=0) uses byte unit address
     // SDHC and SDXC Cards (CCS=1) use block unit address (512 Bytes unit)
     if (SDCARD_V2HC == pSD->card_type) {
@@ -991,9 +1306,16 @@ static int in_sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
             (status = sd_cmd(pSD, CMD25_WRITE_MULTIPLE_BLOCK, addr, false, 0))) {
             return status;
         }
-        // Write the data: one block at a time
+        // Write the data: one block at a time. The next block's CRC is
+        // computed while this one is clocked out.
+        sd_data_frame_t frame;
+        uint16_t crc = sd_block_crc(buffer, _block_size);
         do {
-            response = sd_write_block(pSD, buffer, SPI_START_BLK_MUL_WRITE, _block_size);
+            sd_write_block_start(pSD, &frame, buffer, SPI_START_BLK_MUL_WRITE,
+                                 crc, _block_size);
+            if (blockCnt > 1)
+                crc = sd_block_crc(buffer + _block_size, _block_size);
+            response = sd_write_block_finish(pSD, &frame, false);
             if (response != SPI_DATA_ACCEPTED) {
                 DBG_PRINTF("Multiple Block Write failed: 0x%x\r\n", response);
                 status = SD_BLOCK_DEVICE_ERROR_WRITE;
@@ -1006,6 +1328,9 @@ static int in_sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
          * the beginning of the next block
          */
         sd_spi_write(pSD, SPI_STOP_TRAN);
+        // A stuff byte, then busy while the last of the data is programmed
+        sd_spi_write(pSD, SPI_FILL_CHAR);
+        sd_wait_ready_shared(pSD, SD_COMMAND_TIMEOUT);
     }
     uint32_t stat = 0;
     // Some SD cards want to be deselected between every bus transaction:
@@ -1024,6 +1349,103 @@ int sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
     return status;
 }
 
+/* SWITCH_FUNC (CMD6) returns a 512-bit status data block */
+#define SWITCH_STATUS_SIZE 64
+#define SWITCH_FUNC_CHECK 0x00FFFFF1 /*!< Mode 0: query function 1 (High-Speed) of group 1 */
+#define SWITCH_FUNC_SET 0x80FFFFF1   /*!< Mode 1: switch group 1 to function 1 */
+
+static int sd_switch_func(sd_card_t *pSD, uint32_t arg, uint8_t *status) {
+    int rc = sd_cmd(pSD, CMD6_SWITCH_FUNC, arg, false, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+    return sd_read_bytes(pSD, status, SWITCH_STATUS_SIZE);
+}
+
+/* Switch the card to High-Speed mode (up to 50 MHz), if it supports it */
+static bool sd_go_high_speed(sd_card_t *pSD) {
+    uint8_t status[SWITCH_STATUS_SIZE];
+
+    // CMD6 is only in Physical Layer Specification Version 1.10 and later
+    if (SDCARD_V1 == pSD->card_type) return false;
+    if (SD_BLOCK_DEVICE_ERROR_NONE !=
+        sd_switch_func(pSD, SWITCH_FUNC_CHECK, status))
+        return false;
+    // Support bits for function group 1: [415:400]. Function 1 is High-Speed.
+    if (!ext_bits_n(status, sizeof status, 401, 401)) {
+        DBG_PRINTF("High-Speed mode not supported\r\n");
+        return false;
+    }
+    if (SD_BLOCK_DEVICE_ERROR_NONE !=
+        sd_switch_func(pSD, SWITCH_FUNC_SET, status))
+        return false;
+    // Function group 1 switch result: [379:376]
+    if (1 != ext_bits_n(status, sizeof status, 379, 376)) {
+        DBG_PRINTF("Switch to High-Speed mode failed\r\n");
+        return false;
+    }
+    // The new timing takes effect 8 clocks after the end of the status block
+    sd_spi_write(pSD, SPI_FILL_CHAR);
+    return true;
+}
+
+#if SD_CRC_ENABLED
+#define SD_BAUD_TEST_READS 4 /*!< Test block reads at each candidate rate */
+
+/* Read block 0 with CMD17. Returns its CRC16, or -1 on any error. */
+static int sd_test_read(sd_card_t *pSD, uint8_t *buffer) {
+    // Address 0 is the same in byte and block units
+    if (SD_BLOCK_DEVICE_ERROR_NONE !=
+        sd_cmd(pSD, CMD17_READ_SINGLE_BLOCK, 0x0, false, 0))
+        return -1;
+    if (SD_BLOCK_DEVICE_ERROR_NONE != sd_read_block(pSD, buffer, _block_size))
+        return -1;
+    return crc16((void *)buffer, _block_size);
+}
+#endif
+
+/* Step the SPI clock up from spi->baud_rate, reading test blocks with CRC
+   checks, and settle on the fastest rate that reads reliably. */
+static void sd_negotiate_baud_rate(sd_card_t *pSD) {
+    uint limit = pSD->high_speed ? 50 * 1000 * 1000 : 25 * 1000 * 1000;
+    if (pSD->max_baud_rate && pSD->max_baud_rate < limit)
+        limit = pSD->max_baud_rate;
+    uint good = pSD->spi->baud_rate;
+
+#if SD_CRC_ENABLED
+    // Without CRCs there is no way to tell a good read from a bad one
+    if (crc_on && good < limit) {
+        uint8_t buffer[BLOCK_SIZE_HC];
+        pSD->baud_rate = good;
+        uint good_actual = sd_spi_set_baudrate(pSD, good);
+        int reference = sd_test_read(pSD, buffer);
+        uint candidate = good;
+        while (reference >= 0 && candidate < limit) {
+            candidate = candidate * 2 < limit ? candidate * 2 : limit;
+            pSD->baud_rate = candidate;
+            uint actual = sd_spi_set_baudrate(pSD, candidate);
+            if (actual == good_actual) continue;  // Same clock divider
+            bool ok = true;
+            for (int i = 0; ok && i < SD_BAUD_TEST_READS; ++i)
+                ok = sd_test_read(pSD, buffer) == reference;
+            if (!ok) {
+                DBG_PRINTF("%s: %u Hz failed\r\n", __FUNCTION__, actual);
+                // Clock out whatever is left of the failed block at a good rate
+                pSD->baud_rate = good;
+                sd_spi_set_baudrate(pSD, good);
+                sd_spi_transfer(pSD, NULL, buffer, sizeof buffer);
+                sd_wait_ready(pSD, SD_COMMAND_TIMEOUT);
+                break;
+            }
+            good = candidate;
+            good_actual = actual;
+        }
+    }
+#endif
+    pSD->baud_rate = good;
+    uint actual = sd_spi_set_baudrate(pSD, good);
+    printf("%s: SPI clock %u Hz (requested %u)%s\r\n", pSD->pcName, actual,
+           good, pSD->high_speed ? ", High-Speed mode" : "");
+}
+
 static int sd_init_medium(sd_card_t *pSD) {
     int32_t status = SD_BLOCK_DEVICE_ERROR_NONE;
     uint32_t response, arg;
@@ -1089,6 +1511,8 @@ static int sd_init_medium(sd_card_t *pSD) {
     absolute_time_t timeout_time = make_timeout_time_ms(SD_COMMAND_TIMEOUT);
     do {
         status = sd_cmd(pSD, ACMD41_SD_SEND_OP_COND, arg, true, &response);
+        // Still initializing
+        if (response & R1_IDLE_STATE) sd_sleep_ms(1);
     } while (response & R1_IDLE_STATE &&
              0 < absolute_time_diff_us(get_absolute_time(), timeout_time));
 
@@ -1199,6 +1623,9 @@ static int sd_init(sd_card_t *pSD) {
     }
     // Initialize the member variables
     pSD->card_type = SDCARD_NONE;
+    pSD->high_speed = false;
+    pSD->baud_rate = 0;
+    memset(&pSD->info, 0, sizeof pSD->info);
 
     sd_spi_acquire(pSD);
 
@@ -1210,9 +1637,8 @@ static int sd_init(sd_card_t *pSD) {
         return pSD->m_Status;
     }
     DBG_PRINTF("SD card initialized\r\n");
-    pSD->sectors = sd_sectors_nolock(pSD);
-    if (0 == pSD->sectors) {
-        // CMD9 failed
+    if (SD_BLOCK_DEVICE_ERROR_NONE != sd_read_card_ids(pSD)) {
+        // CMD58, CMD9 or CMD10 failed
         sd_spi_release(pSD);
         sd_unlock(pSD);
         return pSD->m_Status;
@@ -1224,10 +1650,19 @@ static int sd_init(sd_card_t *pSD) {
         sd_unlock(pSD);
         return pSD->m_Status;
     }
-    // Set SCK for data transfer
-    sd_spi_go_high_frequency(pSD);
+    // Set SCK for data transfer: switch to High-Speed mode, if supported, and
+    // find the fastest reliable rate for this card
+    pSD->high_speed = sd_go_high_speed(pSD);
+    sd_negotiate_baud_rate(pSD);
+
+    // Speed class and erase block size (for f_mkfs alignment; see
+    // GET_BLOCK_SIZE). Not fatal: the card works without them.
+    if (SD_BLOCK_DEVICE_ERROR_NONE != sd_read_card_status(pSD))
+        DBG_PRINTF("Couldn't read SCR or SD Status\r\n");
 
     // The card is now initialized
+    pSD->sectors = pSD->info.sectors;
+    pSD->info.valid = true;
     pSD->m_Status &= ~STA_NOINIT;
 
     sd_spi_release(pSD);
@@ -1265,6 +1700,7 @@ static bool sd_test_com(sd_card_t *pSD) {
             if (!success) {
                 // Card no longer sensed - ensure card is initialized once re-attached
                 pSD->m_Status |= STA_NOINIT;
+                pSD->info.valid = false;
             }
         } else {
             // SD card is currently holding DO which is sufficient enough to know it's still there
@@ -1275,6 +1711,8 @@ static bool sd_test_com(sd_card_t *pSD) {
 
         // Initialize the member variables
         pSD->card_type = SDCARD_NONE;
+        pSD->high_speed = false;
+        pSD->baud_rate = 0;
 
         sd_spi_go_low_frequency(pSD);
         sd_spi_send_initializing_sequence(pSD);
@@ -32,6 +32,32 @@ extern "C" {
 
 typedef struct sd_card_t sd_card_t;
 
+// Card registers, read once by sd_init and served from RAM until the card is
+// removed or re-initialized (valid is false in between)
+typedef struct {
+    bool valid;
+    // Raw registers, as sent by the card (MSB first)
+    uint8_t csd[16];
+    uint8_t cid[16];
+    uint8_t scr[8];
+    uint8_t sd_status[64];  // ACMD13; all zeros if it couldn't be read
+    uint32_t ocr;
+    // Decoded:
+    uint64_t sectors;         // Capacity in 512-byte sectors
+    uint8_t manufacturer_id;  // CID MID
+    char oem_id[3];           // CID OID, NUL terminated
+    char product_name[6];     // CID PNM, NUL terminated
+    uint8_t product_rev;      // CID PRV, BCD n.m
+    uint32_t serial_number;   // CID PSN
+    uint16_t mfg_year;        // CID MDT
+    uint8_t mfg_month;
+    uint8_t sd_spec;          // Physical Layer Specification major version, from SCR
+    uint8_t speed_class;      // 0 (Class 0), 2, 4, 6 or 10, from SD Status
+    uint8_t uhs_speed_grade;  // 0, 1 or 3 (U1, U3)
+    uint8_t video_speed_class;  // 0, 6, 10, 30, 60 or 90 (V6 ... V90)
+    uint32_t au_sectors;      // Allocation unit in sectors; 0 if unknown
+} sd_card_info_t;
+
 // "Class" representing SD Cards
 struct sd_card_t {
     const char *pcName;
@@ -46,14 +72,27 @@ struct sd_card_t {
     // GPIO_DRIVE_STRENGTH_12MA = 3 }
     bool set_drive_strength;
     enum gpio_drive_strength ss_gpio_drive_strength;
+    // Upper limit for SPI baud rate negotiation. 0 means the card's own limit:
+    // 25 MHz, or 50 MHz once switched to High-Speed mode. The negotiation
+    // starts from spi->baud_rate, which should be a rate known to work.
+    uint max_baud_rate;
 
     // Following fields are used to keep track of the state of the card:
     int m_Status;                                    // Card status
     uint64_t sectors;                                // Assigned dynamically
     int card_type;                                   // Assigned dynamically
+    bool high_speed;                                 // Switched with CMD6
+    uint baud_rate;                                  // Negotiated; 0 if not yet
+    sd_card_info_t info;                             // See sd_card_info()
     mutex_t mutex;
     FATFS fatfs;
     bool mounted;
+    // Statistics: divide to get SD write commands per sector written
+    uint32_t write_commands;                         // CMD24 or CMD25
+    uint32_t sectors_written;
+    uint32_t cache_hits;                             // Sector cache in glue.c
+    uint32_t cache_misses;
+    uint32_t cache_write_backs;
 
     int (*init)(sd_card_t *sd_card_p);
     int (*write_blocks)(sd_card_t *sd_card_p, const uint8_t *buffer,
@@ -89,6 +128,8 @@ struct sd_card_t {
 
 bool sd_card_detect(sd_card_t *pSD);
 uint64_t sd_sectors(sd_card_t *pSD);
+const sd_card_info_t *sd_card_info(sd_card_t *pSD);
+void sd_card_stats_print(sd_card_t *pSD);
 
 bool sd_init_driver();
 bool sd_card_detect(sd_card_t *sd_card_p);
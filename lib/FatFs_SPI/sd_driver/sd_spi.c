@@ -30,13 +30,20 @@ specific language governing permissions and limitations under the License.
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-variable"
 
-void sd_spi_go_high_frequency(sd_card_t *pSD) {
-    uint actual = spi_set_baudrate(pSD->spi->hw_inst, pSD->spi->baud_rate);
+// Returns the actual frequency
+uint sd_spi_set_baudrate(sd_card_t *pSD, uint baud_rate) {
+    if (pSD->spi->current_baud_rate == baud_rate)
+        return spi_get_baudrate(pSD->spi->hw_inst);
+    uint actual = spi_set_baudrate(pSD->spi->hw_inst, baud_rate);
+    pSD->spi->current_baud_rate = baud_rate;
     TRACE_PRINTF("%s: Actual frequency: %lu\n", __FUNCTION__, (long)actual);
+    return actual;
+}
+void sd_spi_go_high_frequency(sd_card_t *pSD) {
+    sd_spi_set_baudrate(pSD, pSD->baud_rate ? pSD->baud_rate : pSD->spi->baud_rate);
 }
 void sd_spi_go_low_frequency(sd_card_t *pSD) {
-    uint actual = spi_set_baudrate(pSD->spi->hw_inst, 400 * 1000); // Actual frequency: 398089
-    TRACE_PRINTF("%s: Actual frequency: %lu\n", __FUNCTION__, (long)actual);
+    sd_spi_set_baudrate(pSD, 400 * 1000); // Actual frequency: 398089
 }
 
 #pragma GCC diagnostic pop
@@ -78,6 +85,8 @@ void sd_spi_deselect_pulse(sd_card_t *pSD) {
 }
 void sd_spi_acquire(sd_card_t *pSD) {
     sd_spi_lock(pSD);
+    // Cards sharing an SPI may have negotiated different rates
+    if (pSD->baud_rate) sd_spi_set_baudrate(pSD, pSD->baud_rate);
     sd_spi_select(pSD);
 }
 
@@ -91,6 +100,21 @@ bool sd_spi_transfer(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx,
     return spi_transfer(pSD->spi, tx, rx, length);
 }
 
+void sd_spi_transfer_start(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx,
+                           size_t length) {
+    spi_transfer_start(pSD->spi, tx, rx, length);
+}
+bool sd_spi_transfer_wait(sd_card_t *pSD) {
+    return spi_transfer_wait(pSD->spi);
+}
+
+void sd_spi_sg_start(sd_card_t *pSD, spi_sg_list_t *list_p) {
+    spi_sg_start(pSD->spi, list_p);
+}
+bool sd_spi_sg_wait(sd_card_t *pSD, uint8_t *last_rx_p) {
+    return spi_sg_wait(pSD->spi, last_rx_p);
+}
+
 uint8_t sd_spi_write(sd_card_t *pSD, const uint8_t value) {
     // TRACE_PRINTF("%s\n", __FUNCTION__);
     uint8_t received = SPI_FILL_CHAR;
@@ -104,6 +128,13 @@ uint8_t sd_spi_write(sd_card_t *pSD, const uint8_t value) {
     return received;
 }
 
+/* Receive a few bytes, sending SPI_FILL_CHAR, by polling the SPI FIFOs.
+For a byte or two this is much cheaper than setting up DMA and taking the
+interrupt. The DMA channels must be idle. */
+void sd_spi_read_polled(sd_card_t *pSD, uint8_t *rx, size_t length) {
+    spi_read_blocking(pSD->spi->hw_inst, SPI_FILL_CHAR, rx, length);
+}
+
 void sd_spi_send_initializing_sequence(sd_card_t * pSD) {
     bool old_ss = gpio_get(pSD->ss_gpio);
     // Set DI and CS high and apply 74 or more clock pulses to SCLK:
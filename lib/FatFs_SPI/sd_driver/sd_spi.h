@@ -21,12 +21,18 @@ specific language governing permissions and limitations under the License.
 /* Transfer tx to SPI while receiving SPI to rx. 
 tx or rx can be NULL if not important. */
 bool sd_spi_transfer(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx, size_t length);
+void sd_spi_transfer_start(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx, size_t length);
+bool sd_spi_transfer_wait(sd_card_t *pSD);
+void sd_spi_sg_start(sd_card_t *pSD, spi_sg_list_t *list_p);
+bool sd_spi_sg_wait(sd_card_t *pSD, uint8_t *last_rx_p);
 uint8_t sd_spi_write(sd_card_t *pSD, const uint8_t value);
+void sd_spi_read_polled(sd_card_t *pSD, uint8_t *rx, size_t length);
 void sd_spi_deselect_pulse(sd_card_t *pSD);
 void sd_spi_acquire(sd_card_t *pSD);
 void sd_spi_release(sd_card_t *pSD);
 void sd_spi_go_low_frequency(sd_card_t *this);
 void sd_spi_go_high_frequency(sd_card_t *this);
+uint sd_spi_set_baudrate(sd_card_t *pSD, uint baud_rate);
 
 /* 
 After power up, the host starts the clock and sends the initializing sequence on the CMD line. 
@@ -0,0 +1,144 @@
+// SD command latency trace: see sd_trace.h
+
+#include <stdio.h>
+#include <string.h>
+//
+#include "FreeRTOS.h"
+#include "task.h"
+//
+#include "ff.h"
+#include "my_debug.h"
+//
+#include "sd_trace.h"
+
+#if SD_TRACE_ENABLED
+
+_Static_assert(!(SD_TRACE_ENTRIES & (SD_TRACE_ENTRIES - 1)),
+               "SD_TRACE_ENTRIES must be a power of two");
+
+static sd_trace_entry_t ring[SD_TRACE_ENTRIES];
+static uint32_t head;  // Records ever made; the next goes to ring[head % N]
+static volatile bool enabled = true;
+
+void sd_trace_record(const sd_trace_entry_t *entry_p) {
+    if (!enabled) return;
+    taskENTER_CRITICAL();
+    ring[head++ & (SD_TRACE_ENTRIES - 1)] = *entry_p;
+    taskEXIT_CRITICAL();
+}
+
+void sd_trace_enable(bool enable) { enabled = enable; }
+
+void sd_trace_clear(void) {
+    taskENTER_CRITICAL();
+    head = 0;
+    taskEXIT_CRITICAL();
+}
+
+/* Copy up to max records, oldest first. Returns the number copied. */
+size_t sd_trace_snapshot(sd_trace_entry_t *out, size_t max,
+                         uint32_t *dropped_p) {
+    taskENTER_CRITICAL();
+    uint32_t count = head < SD_TRACE_ENTRIES ? head : SD_TRACE_ENTRIES;
+    if (count > max) count = max;
+    uint32_t first = head - count;
+    for (uint32_t i = 0; i < count; ++i)
+        out[i] = ring[(first + i) & (SD_TRACE_ENTRIES - 1)];
+    if (dropped_p) *dropped_p = head - count;
+    taskEXIT_CRITICAL();
+    return count;
+}
+
+/* Walk the ring oldest first with recording paused, so that the consumer
+   (which may itself be writing to an SD card) doesn't disturb it */
+static uint32_t walk(uint32_t *dropped_p,
+                     bool (*visit)(const sd_trace_entry_t *, size_t, void *),
+                     void *arg) {
+    bool was_enabled = enabled;
+    enabled = false;
+    uint32_t count = head < SD_TRACE_ENTRIES ? head : SD_TRACE_ENTRIES;
+    uint32_t first = head - count;
+    if (dropped_p) *dropped_p = first;
+    uint32_t done = 0;
+    while (done < count) {
+        // Contiguous run up to the end of the ring
+        size_t idx = (first + done) & (SD_TRACE_ENTRIES - 1);
+        size_t n = SD_TRACE_ENTRIES - idx;
+        if (n > count - done) n = count - done;
+        if (!visit(&ring[idx], n, arg)) break;
+        done += n;
+    }
+    enabled = was_enabled;
+    return done;
+}
+
+static bool print_run(const sd_trace_entry_t *e, size_t n, void *arg) {
+    (void)arg;
+    for (size_t i = 0; i < n; ++i, ++e)
+        printf("sdtrace,%u,%s%u,0x%08lx,%lu,%lu,%u,%u,%u,%u\n", e->card,
+               e->cmd & SD_TRACE_ACMD ? "A" : "", e->cmd & ~SD_TRACE_ACMD,
+               (unsigned long)e->arg, (unsigned long)e->start_us,
+               (unsigned long)e->end_us, e->busy_us, e->retries, e->status,
+               e->error);
+    return true;
+}
+
+/* Print the ring as CSV lines prefixed "sdtrace," (easy to grep out of a
+   serial capture) */
+void sd_trace_dump(void) {
+    printf("sdtrace,card,cmd,arg,start_us,end_us,busy_us,retries,status,error\n");
+    uint32_t dropped;
+    uint32_t count = walk(&dropped, print_run, NULL);
+    printf("sdtrace: %lu records, %lu overwritten\n", (unsigned long)count,
+           (unsigned long)dropped);
+}
+
+static bool write_run(const sd_trace_entry_t *e, size_t n, void *arg) {
+    FIL *fil_p = arg;
+    UINT bw;
+    FRESULT fr = f_write(fil_p, e, n * sizeof *e, &bw);
+    return FR_OK == fr && bw == n * sizeof *e;
+}
+
+/* Save the ring in binary (see sd_trace_file_header_t). Returns a FRESULT. */
+int sd_trace_save(const char *path) {
+    FIL fil;
+    FRESULT fr = f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (FR_OK != fr) return fr;
+    bool was_enabled = enabled;
+    enabled = false;
+    sd_trace_file_header_t header = {
+        .magic = SD_TRACE_MAGIC,
+        .version = SD_TRACE_VERSION,
+        .entry_size = sizeof(sd_trace_entry_t),
+        .count = head < SD_TRACE_ENTRIES ? head : SD_TRACE_ENTRIES};
+    header.dropped = head - header.count;
+    UINT bw;
+    fr = f_write(&fil, &header, sizeof header, &bw);
+    if (FR_OK == fr && walk(NULL, write_run, &fil) != header.count)
+        fr = FR_DISK_ERR;
+    enabled = was_enabled;
+    FRESULT fr2 = f_close(&fil);
+    return FR_OK == fr ? fr2 : fr;
+}
+
+#else  // !SD_TRACE_ENABLED
+
+void sd_trace_enable(bool enable) { (void)enable; }
+void sd_trace_clear(void) {}
+size_t sd_trace_snapshot(sd_trace_entry_t *out, size_t max,
+                         uint32_t *dropped_p) {
+    (void)out;
+    (void)max;
+    if (dropped_p) *dropped_p = 0;
+    return 0;
+}
+void sd_trace_dump(void) { printf("sdtrace: disabled (SD_TRACE_ENABLED)\n"); }
+int sd_trace_save(const char *path) {
+    (void)path;
+    return FR_INVALID_PARAMETER;
+}
+
+#endif
+
+/* [] END OF FILE */
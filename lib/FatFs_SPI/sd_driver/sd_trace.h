@@ -0,0 +1,72 @@
+// SD command latency trace.
+//
+// Every command that goes through sd_cmd() leaves a fixed-size binary record
+// in a ring buffer: opcode, argument, start and end times, how long the card
+// held DO low (busy) before and after the command, and how many times it had
+// to be resent. Recording is a handful of stores inside a critical section.
+// The ring can be printed (sd_trace_dump) or saved to a file (sd_trace_save)
+// for histograma_sd.py.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SD_TRACE_ENABLED
+#define SD_TRACE_ENABLED 0
+#endif
+#ifndef SD_TRACE_ENTRIES
+#define SD_TRACE_ENTRIES 256 /*!< Ring size; a power of two */
+#endif
+
+#define SD_TRACE_ACMD 0x80      /*!< sd_trace_entry_t::cmd flag: ACMD<n> */
+#define SD_TRACE_NO_STATUS 0xFF /*!< sd_trace_entry_t::status: no response */
+
+/* File format written by sd_trace_save (all little-endian):
+   sd_trace_file_header_t, then `count` sd_trace_entry_t, oldest first. */
+#define SD_TRACE_MAGIC 0x52544453 /*!< "SDTR" */
+#define SD_TRACE_VERSION 1
+
+typedef struct {
+    uint32_t start_us;  // time_us_32() when sd_cmd() was entered
+    uint32_t end_us;    // ... and when it returned
+    uint32_t arg;
+    uint16_t busy_us;   // Waiting for the card to release DO (saturates)
+    uint8_t cmd;        // Command index, | SD_TRACE_ACMD for application cmds
+    uint8_t retries;    // Resends after no response
+    uint8_t card;       // Index into the sd_cards[] table
+    uint8_t status;     // R1, or SD_TRACE_NO_STATUS
+    uint16_t error;     // -(SD_BLOCK_DEVICE_ERROR_*) returned by sd_cmd()
+} sd_trace_entry_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size;  // sizeof(sd_trace_entry_t)
+    uint32_t count;
+    uint32_t dropped;     // Records overwritten before the save
+} sd_trace_file_header_t;
+
+#if SD_TRACE_ENABLED
+void sd_trace_record(const sd_trace_entry_t *entry_p);
+#else
+static inline void sd_trace_record(const sd_trace_entry_t *entry_p) {
+    (void)entry_p;
+}
+#endif
+
+void sd_trace_enable(bool enable);
+void sd_trace_clear(void);
+size_t sd_trace_snapshot(sd_trace_entry_t *out, size_t max, uint32_t *dropped_p);
+void sd_trace_dump(void);
+int sd_trace_save(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+/* [] END OF FILE */
@@ -14,10 +14,14 @@ specific language governing permissions and limitations under the License.
 
 #include <assert.h>
 #include <stdbool.h>
+#include <string.h>
 //
 #include "pico/stdlib.h"
 #include "pico/mutex.h"
-#include "pico/sem.h"
+//
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
 //
 #include "my_debug.h"
 #include "hw_config.h"
@@ -27,7 +31,10 @@ specific language governing permissions and limitations under the License.
 static bool irqChannel1 = false;
 static bool irqShared = true;
 
+static const uint8_t fill_char = SPI_FILL_CHAR;
+
 static void in_spi_irq_handler(const uint DMA_IRQ_num, io_rw_32 *dma_hw_ints_p) {
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     for (size_t i = 0; i < spi_get_num(); ++i) {
         spi_t *spi_p = spi_get_by_num(i);
         if (DMA_IRQ_num == spi_p->DMA_IRQ_num)  {
@@ -35,12 +42,17 @@ static void in_spi_irq_handler(const uint DMA_IRQ_num, io_rw_32 *dma_hw_ints_p)
             if (*dma_hw_ints_p & (1 << spi_p->rx_dma)) {
                 *dma_hw_ints_p = 1 << spi_p->rx_dma;  // Clear it.
                 assert(!dma_channel_is_busy(spi_p->rx_dma));
-                assert(!sem_available(&spi_p->sem));
-                bool ok = sem_release(&spi_p->sem);
-                assert(ok);
+                spi_p->irq_time = time_us_32();
+                spi_p->done = true;
+                // Wake the task waiting in spi_transfer_wait(), if it's blocked
+                TaskHandle_t owner = spi_p->owner;
+                if (owner)
+                    vTaskNotifyGiveIndexedFromISR(owner, SPI_NOTIFY_INDEX,
+                                                  &xHigherPriorityTaskWoken);
             }
         }
     }
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 static void __not_in_flash_func(spi_irq_handler_0)() {
     in_spi_irq_handler(DMA_IRQ_0, &dma_hw->ints0);
@@ -54,12 +66,44 @@ void set_spi_dma_irq_channel(bool useChannel1, bool shared) {
     irqShared = shared;
 }
 
+// Get ready for the RX channel's completion interrupt
+static void arm_completion(spi_t *spi_p, size_t length) {
+    switch (spi_p->DMA_IRQ_num) {
+        case DMA_IRQ_0:
+            assert(!dma_channel_get_irq0_status(spi_p->rx_dma));
+            break;
+        case DMA_IRQ_1:
+            assert(!dma_channel_get_irq1_status(spi_p->rx_dma));
+            break;
+        default:
+            assert(false);
+    }
+    spi_p->done = false;
+    // Long transfers block the calling task until the ISR notifies it; short
+    // ones aren't worth the two context switches, and are spun on. So is
+    // everything before the scheduler is running.
+    if (length >= SPI_BLOCKING_THRESHOLD &&
+        taskSCHEDULER_RUNNING == xTaskGetSchedulerState()) {
+        spi_p->owner = xTaskGetCurrentTaskHandle();
+        // Clear a notification left over from a transfer that timed out
+        ulTaskNotifyTakeIndexed(SPI_NOTIFY_INDEX, pdTRUE, 0);
+    } else {
+        spi_p->owner = NULL;
+    }
+}
+
 // SPI Transfer: Read & Write (simultaneously) on SPI bus
 //   If the data that will be received is not important, pass NULL as rx.
 //   If the data that will be transmitted is not important,
 //     pass NULL as tx and then the SPI_FILL_CHAR is sent out as each data
 //     element.
-bool spi_transfer(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
+//
+// The transfer can also be split in two: spi_transfer_start() sets up and
+// starts the DMA and returns at once, so the caller can get on with something
+// else (checking the previous block's CRC, say) while the bytes are clocked.
+// spi_transfer_wait() must be called before the next transfer on the SPI.
+void spi_transfer_start(spi_t *spi_p, const uint8_t *tx, uint8_t *rx,
+                        size_t length) {
     // assert(512 == length || 1 == length);
     assert(tx || rx);
     // assert(!(tx && rx));
@@ -68,8 +112,7 @@ bool spi_transfer(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
     if (tx) {
         channel_config_set_read_increment(&spi_p->tx_dma_cfg, true);
     } else {
-        static const uint8_t dummy = SPI_FILL_CHAR;
-        tx = &dummy;
+        tx = &fill_char;
         channel_config_set_read_increment(&spi_p->tx_dma_cfg, false);
     }
 
@@ -95,67 +138,167 @@ bool spi_transfer(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
                                    // size transfer_data_size)
                           false);  // start
 
-    switch (spi_p->DMA_IRQ_num) {
-        case DMA_IRQ_0:
-            assert(!dma_channel_get_irq0_status(spi_p->rx_dma));
-            break;
-        case DMA_IRQ_1:
-            assert(!dma_channel_get_irq1_status(spi_p->rx_dma));
-            break;
-        default:
-            assert(false);
-    }
-    sem_reset(&spi_p->sem, 0);
+    arm_completion(spi_p, length);
 
     // start them exactly simultaneously to avoid races (in extreme cases
     // the FIFO could overflow)
     dma_start_channel_mask((1u << spi_p->tx_dma) | (1u << spi_p->rx_dma));
+}
 
+bool spi_transfer_wait(spi_t *spi_p) {
     /* Wait until master completes transfer or time out has occured. */
-    uint32_t timeOut = 1000; /* Timeout 1 sec */
-    bool rc = sem_acquire_timeout_ms(
-        &spi_p->sem, timeOut);  // Wait for notification from ISR
-    if (!rc) {
+    const uint32_t timeOut = 1000; /* Timeout 1 sec */
+    if (spi_p->owner) {
+        if (!spi_p->done) {
+            // Wait for notification from ISR. Other tasks run meanwhile.
+            ++spi_p->transfers_blocked;
+            ulTaskNotifyTakeIndexed(SPI_NOTIFY_INDEX, pdTRUE,
+                                    pdMS_TO_TICKS(timeOut));
+            if (spi_p->done) {
+                uint32_t latency = time_us_32() - spi_p->irq_time;
+                spi_p->wake_latency_us_total += latency;
+                if (latency > spi_p->wake_latency_us_max)
+                    spi_p->wake_latency_us_max = latency;
+            }
+        }
+    } else {
+        absolute_time_t timeout_time = make_timeout_time_ms(timeOut);
+        while (!spi_p->done &&
+               0 < absolute_time_diff_us(get_absolute_time(), timeout_time))
+            tight_loop_contents();
+    }
+    spi_p->owner = NULL;
+    if (!spi_p->done) {
         // If the timeout is reached the function will return false
         DBG_PRINTF("Notification wait timed out in %s\n", __FUNCTION__);
+        dma_channel_abort(spi_p->ctrl_dma);
+        dma_channel_abort(spi_p->rx_dma);
+        dma_channel_abort(spi_p->tx_dma);
         return false;
     }
-    // Shouldn't be necessary:
-    dma_channel_wait_for_finish_blocking(spi_p->tx_dma);
-    dma_channel_wait_for_finish_blocking(spi_p->rx_dma);
-
-    assert(!sem_available(&spi_p->sem));
+    // The RX channel finishing implies the TX channel has too: every byte
+    // sent clocks one in.
     assert(!dma_channel_is_busy(spi_p->tx_dma));
     assert(!dma_channel_is_busy(spi_p->rx_dma));
+    ++spi_p->transfers;
 
     return true;
 }
 
+void spi_stats_print(spi_t *spi_p) {
+    printf("SPI%u: %lu transfers, %lu blocked (%lu%%), wake latency mean %lu us, "
+           "max %lu us\n",
+           spi_get_index(spi_p->hw_inst), (unsigned long)spi_p->transfers,
+           (unsigned long)spi_p->transfers_blocked,
+           spi_p->transfers
+               ? (unsigned long)(100ULL * spi_p->transfers_blocked / spi_p->transfers)
+               : 0UL,
+           spi_p->transfers_blocked
+               ? (unsigned long)(spi_p->wake_latency_us_total / spi_p->transfers_blocked)
+               : 0UL,
+           (unsigned long)spi_p->wake_latency_us_max);
+}
+
+bool spi_transfer(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
+    spi_transfer_start(spi_p, tx, rx, length);
+    return spi_transfer_wait(spi_p);
+}
+
+// Scatter-gather transfers
+//   A frame made of several pieces (command packet, fill bytes, token,
+//   payload, CRC...) is clocked out by one DMA chain, with one setup and one
+//   completion interrupt for the lot. Each segment is a descriptor in the
+//   layout of the TX channel's alias 3 registers (CTRL, WRITE_ADDR,
+//   TRANS_COUNT, READ_ADDR_TRIG). The control channel copies one into the TX
+//   channel, which triggers it; when the segment is done the TX channel chains
+//   back to the control channel for the next one. The all-zero descriptor at
+//   the end is a null trigger, which stops the chain. Meanwhile the RX channel
+//   drains the whole frame to a single byte, so what is left there is the
+//   last byte received (a data response token, for example).
+//   The list and everything it points to must stay put until spi_sg_wait().
+
+void spi_sg_init(spi_sg_list_t *list_p) {
+    list_p->count = 0;
+    list_p->length = 0;
+}
+
+// tx NULL means send SPI_FILL_CHAR
+bool spi_sg_append(spi_t *spi_p, spi_sg_list_t *list_p, const uint8_t *tx,
+                   size_t length) {
+    if (SPI_SG_MAX_SEGMENTS <= list_p->count || !length) return false;
+    dma_channel_config cfg = spi_p->tx_dma_cfg;
+    channel_config_set_read_increment(&cfg, tx);
+    channel_config_set_chain_to(&cfg, spi_p->ctrl_dma);
+    // No interrupt per segment: the RX channel reports completion
+    channel_config_set_irq_quiet(&cfg, true);
+    spi_sg_desc_t *desc_p = &list_p->desc[list_p->count++];
+    desc_p->ctrl = channel_config_get_ctrl_value(&cfg);
+    desc_p->write_addr = &spi_get_hw(spi_p->hw_inst)->dr;
+    desc_p->transfer_count = length;
+    desc_p->read_addr = tx ? tx : &fill_char;
+    list_p->length += length;
+    return true;
+}
+
+void spi_sg_start(spi_t *spi_p, spi_sg_list_t *list_p) {
+    assert(list_p->count);
+    // Null trigger: ends the chain
+    memset(&list_p->desc[list_p->count], 0, sizeof list_p->desc[0]);
+
+    channel_config_set_write_increment(&spi_p->rx_dma_cfg, false);
+    dma_channel_configure(spi_p->rx_dma, &spi_p->rx_dma_cfg,
+                          &spi_p->sg_last_rx,                // write address
+                          &spi_get_hw(spi_p->hw_inst)->dr,  // read address
+                          list_p->length, false);
+    dma_channel_configure(spi_p->ctrl_dma, &spi_p->ctrl_dma_cfg,
+                          &dma_hw->ch[spi_p->tx_dma].al3_ctrl,  // write address
+                          list_p->desc,                         // read address
+                          sizeof list_p->desc[0] / sizeof(uint32_t),
+                          false);
+    arm_completion(spi_p, list_p->length);
+    // The control channel loads and triggers the first TX segment
+    dma_start_channel_mask((1u << spi_p->ctrl_dma) | (1u << spi_p->rx_dma));
+}
+
+// Returns false on timeout. *last_rx_p (if not NULL) gets the last byte
+// received.
+bool spi_sg_wait(spi_t *spi_p, uint8_t *last_rx_p) {
+    if (!spi_transfer_wait(spi_p)) return false;
+    if (last_rx_p) *last_rx_p = spi_p->sg_last_rx;
+    return true;
+}
+
+// The SPI may be shared (using multiple SSs); protect it. A FreeRTOS mutex
+// has priority inheritance, so a low priority task holding the bus through a
+// long transfer is boosted instead of starving a higher priority one. Before
+// the scheduler runs there is only one thread of execution, and nothing to
+// lock against.
 void spi_lock(spi_t *spi_p) {
-    assert(mutex_is_initialized(&spi_p->mutex));
-    mutex_enter_blocking(&spi_p->mutex);
+    assert(spi_p->mutex);
+    if (taskSCHEDULER_RUNNING == xTaskGetSchedulerState())
+        xSemaphoreTake(spi_p->mutex, portMAX_DELAY);
 }
 void spi_unlock(spi_t *spi_p) {
-    assert(mutex_is_initialized(&spi_p->mutex));
-    mutex_exit(&spi_p->mutex);
+    assert(spi_p->mutex);
+    if (taskSCHEDULER_RUNNING == xTaskGetSchedulerState())
+        xSemaphoreGive(spi_p->mutex);
 }
 
 bool my_spi_init(spi_t *spi_p) {
     auto_init_mutex(my_spi_init_mutex);
     mutex_enter_blocking(&my_spi_init_mutex);
     if (!spi_p->initialized) {
-        //// The SPI may be shared (using multiple SSs); protect it
-        //spi_p->mutex = xSemaphoreCreateRecursiveMutex();
-        //xSemaphoreTakeRecursive(spi_p->mutex, portMAX_DELAY);
-        if (!mutex_is_initialized(&spi_p->mutex)) mutex_init(&spi_p->mutex);
+        // The SPI may be shared (using multiple SSs); protect it
+        if (!spi_p->mutex) spi_p->mutex = xSemaphoreCreateMutex();
+        if (!spi_p->mutex) {
+            mutex_exit(&my_spi_init_mutex);
+            return false;
+        }
         spi_lock(spi_p);
 
         // Default:
         if (!spi_p->baud_rate)
             spi_p->baud_rate = 10 * 1000 * 1000;
-        // For the IRQ notification:
-        sem_init(&spi_p->sem, 0, 1);
-
         /* Configure component */
         // Enable SPI at 100 kHz and connect to GPIOs
         spi_init(spi_p->hw_inst, 100 * 1000);
@@ -186,6 +329,7 @@ bool my_spi_init(spi_t *spi_p) {
         // Grab some unused dma channels
         spi_p->tx_dma = dma_claim_unused_channel(true);
         spi_p->rx_dma = dma_claim_unused_channel(true);
+        spi_p->ctrl_dma = dma_claim_unused_channel(true);
 
         spi_p->tx_dma_cfg = dma_channel_get_default_config(spi_p->tx_dma);
         spi_p->rx_dma_cfg = dma_channel_get_default_config(spi_p->rx_dma);
@@ -210,6 +354,16 @@ bool my_spi_init(spi_t *spi_p) {
                                                        : DREQ_SPI0_RX);
         channel_config_set_read_increment(&spi_p->rx_dma_cfg, false);
 
+        // The control channel for scatter-gather transfers (see spi_sg_start)
+        // copies a four word descriptor into the TX channel's alias 3
+        // registers each time it is triggered. The write address wraps on a
+        // 16 byte ring; the read address walks along the descriptor list.
+        spi_p->ctrl_dma_cfg = dma_channel_get_default_config(spi_p->ctrl_dma);
+        channel_config_set_transfer_data_size(&spi_p->ctrl_dma_cfg, DMA_SIZE_32);
+        channel_config_set_read_increment(&spi_p->ctrl_dma_cfg, true);
+        channel_config_set_write_increment(&spi_p->ctrl_dma_cfg, true);
+        channel_config_set_ring(&spi_p->ctrl_dma_cfg, true, 4);  // 1 << 4 bytes
+
         /* Theory: we only need an interrupt on rx complete,
         since if rx is complete, tx must also be complete. */
 
@@ -21,12 +21,44 @@ specific language governing permissions and limitations under the License.
 #include "hardware/gpio.h"
 #include "hardware/irq.h"
 #include "hardware/spi.h"
-#include "pico/mutex.h"
-#include "pico/sem.h"
 #include "pico/types.h"
+//
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
 
 #define SPI_FILL_CHAR (0xFF)
 
+// Transfers at least this long block the calling task until the DMA
+// completion interrupt; shorter ones busy-wait
+#ifndef SPI_BLOCKING_THRESHOLD
+#define SPI_BLOCKING_THRESHOLD 64
+#endif
+// Task notification array index used for DMA completion; keeps clear of
+// index 0, which applications use. Needs
+// configTASK_NOTIFICATION_ARRAY_ENTRIES > SPI_NOTIFY_INDEX.
+#ifndef SPI_NOTIFY_INDEX
+#define SPI_NOTIFY_INDEX 1
+#endif
+
+// One segment of a scatter-gather transfer, laid out like a DMA channel's
+// alias 3 registers (see spi_sg_start)
+typedef struct {
+    uint32_t ctrl;
+    volatile void *write_addr;
+    uint32_t transfer_count;
+    const volatile void *read_addr;
+} spi_sg_desc_t;
+
+#ifndef SPI_SG_MAX_SEGMENTS
+#define SPI_SG_MAX_SEGMENTS 6
+#endif
+typedef struct {
+    spi_sg_desc_t desc[SPI_SG_MAX_SEGMENTS + 1];  // + the terminating null
+    size_t count;   // Segments
+    size_t length;  // Bytes, in all
+} spi_sg_list_t;
+
 // "Class" representing SPIs
 typedef struct {
     // SPI HW
@@ -47,12 +79,23 @@ typedef struct {
     // State variables:
     uint tx_dma;
     uint rx_dma;
+    uint ctrl_dma;  // Reloads tx_dma for scatter-gather transfers
     dma_channel_config tx_dma_cfg;
     dma_channel_config rx_dma_cfg;
+    dma_channel_config ctrl_dma_cfg;
+    volatile uint8_t sg_last_rx;  // Where a scatter-gather transfer's RX goes
     irq_handler_t dma_isr; // Ignored: no longer used
     bool initialized;  
-    semaphore_t sem;
-    mutex_t mutex;    
+    uint current_baud_rate; // Last rate requested from spi_set_baudrate
+    SemaphoreHandle_t mutex;
+    volatile TaskHandle_t owner;  // Blocked in spi_transfer_wait(); NULL if spinning
+    volatile bool done;           // Set by the DMA ISR
+    volatile uint32_t irq_time;   // time_us_32() at the DMA ISR
+    // Statistics:
+    uint32_t transfers;
+    uint32_t transfers_blocked;     // Each is a switch away and back
+    uint32_t wake_latency_us_max;   // DMA ISR to the waiting task running
+    uint64_t wake_latency_us_total; // Divide by transfers_blocked for the mean
 } spi_t;
 
 #ifdef __cplusplus
@@ -60,9 +103,16 @@ extern "C" {
 #endif
   
 bool __not_in_flash_func(spi_transfer)(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length);  
+void __not_in_flash_func(spi_transfer_start)(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length);
+bool __not_in_flash_func(spi_transfer_wait)(spi_t *pSPI);
+void spi_sg_init(spi_sg_list_t *list_p);
+bool spi_sg_append(spi_t *pSPI, spi_sg_list_t *list_p, const uint8_t *tx, size_t length);
+void __not_in_flash_func(spi_sg_start)(spi_t *pSPI, spi_sg_list_t *list_p);
+bool __not_in_flash_func(spi_sg_wait)(spi_t *pSPI, uint8_t *last_rx_p);
 void spi_lock(spi_t *pSPI);
 void spi_unlock(spi_t *pSPI);
 bool my_spi_init(spi_t *pSPI);
+void spi_stats_print(spi_t *pSPI);
 void set_spi_dma_irq_channel(bool useChannel1, bool shared);
 
 #ifdef __cplusplus
@@ -11,7 +11,16 @@ under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
 CONDITIONS OF ANY KIND, either express or implied. See the License for the 
 specific language governing permissions and limitations under the License.
 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+//
+#include "FreeRTOS.h"
+#include "task.h"
+//
 #include "ff.h"
+#include "diskio.h"
+#include "f_util.h"
 
 const char *FRESULT_str(FRESULT i) {
     switch (i) {
@@ -103,3 +112,166 @@ FRESULT delete_node (
     if (fr == FR_OK) fr = f_unlink(path);  /* Delete the empty sub-directory */
     return fr;
 }
+
+/* Drive number from the "N:" volume ID, if any */
+static BYTE path_volume(const TCHAR *path) {
+    if (path && path[0] >= '0' && path[0] <= '9' && ':' == path[1])
+        return path[0] - '0';
+    return 0;
+}
+
+/* Format a volume for long sequential writes (data logging).
+
+   f_mkfs aligns the data area to the card's erase block (GET_BLOCK_SIZE,
+   from the AU size in the SD Status), so clusters never straddle an AU. On
+   top of that: one FAT (half the FAT updates), and large clusters (fewer
+   FAT updates per megabyte, and writes that fill whole flash pages). SDHC
+   gets FAT32 with 32 KiB clusters; SDXC gets exFAT with 128 KiB clusters,
+   as the SD File System Specification recommends. */
+FRESULT f_mkfs_for_logging(const TCHAR *path) {
+    BYTE pdrv = path_volume(path);
+
+    if (disk_initialize(pdrv) & STA_NOINIT) return FR_NOT_READY;
+    LBA_t sectors;
+    if (RES_OK != disk_ioctl(pdrv, GET_SECTOR_COUNT, &sectors))
+        return FR_DISK_ERR;
+
+    MKFS_PARM opt = {0};
+    opt.n_fat = 1;
+    opt.align = 0; /* Use GET_BLOCK_SIZE */
+    if (sectors > 64ULL * 1024 * 1024) {
+        /* SDXC (> 32 GiB) */
+        opt.fmt = FM_EXFAT;
+        opt.au_size = 128 * 1024;
+    } else if (sectors >= 4ULL * 1024 * 1024) {
+        /* SDHC (>= 2 GiB): enough clusters for FAT32 at 32 KiB */
+        opt.fmt = FM_FAT32;
+        opt.au_size = 32 * 1024;
+    } else {
+        /* Small card: let f_mkfs choose */
+        opt.fmt = FM_FAT | FM_FAT32;
+        opt.au_size = 0;
+    }
+    /* Passing a work area avoids f_mkfs's own 32 KiB malloc */
+    UINT len = FF_MAX_SS * 8;
+    void *work = malloc(len);
+    if (!work) return FR_NOT_ENOUGH_CORE;
+    FRESULT fr = f_mkfs(path, &opt, work, len);
+    free(work);
+    return fr;
+}
+
+void ff_lock_stats_print(int vol) {
+    ff_lock_stats_t st;
+    ff_lock_stats(vol, &st);
+    if (FF_VOLUMES == vol)
+        printf("System lock: ");
+    else
+        printf("Volume %d lock: ", vol);
+    printf("%lu takes, %lu contended (%lu%%), %lu timeouts, wait mean %lu us, "
+           "max %lu us\n",
+           (unsigned long)st.takes, (unsigned long)st.contended,
+           st.takes ? (unsigned long)(100ULL * st.contended / st.takes) : 0UL,
+           (unsigned long)st.timeouts,
+           st.contended ? (unsigned long)(st.wait_us_total / st.contended) : 0UL,
+           (unsigned long)st.wait_us_max);
+}
+
+/* Lock contention benchmark.
+   Runs `writers` tasks, each appending 512-byte records to its own file on
+   `drive` and syncing every 8 records, plus one status task calling f_stat
+   and f_getfree in a loop, all at the caller's priority, for `seconds`.
+   Then prints each writer's throughput and the volume's lock statistics. The
+   volume must be mounted. Leaves no files behind. */
+
+#define BENCH_MAX_WRITERS 4
+
+typedef struct {
+    const TCHAR *drive;
+    UINT id;              /* 0..writers-1; writers for the status task */
+    TickType_t end;
+    TaskHandle_t parent;
+    uint32_t ops;         /* Records written, or status calls made */
+    FRESULT fr;
+} bench_task_t;
+
+static void bench_name(TCHAR *buf, size_t size, const TCHAR *drive, UINT id) {
+    snprintf(buf, size, "%sbench%u.bin", drive, id);
+}
+
+static void bench_writer(void *arg) {
+    bench_task_t *t = arg;
+    TCHAR name[32];
+    FIL fil;
+    BYTE *rec = malloc(512);
+    bench_name(name, sizeof name, t->drive, t->id);
+    t->fr = rec ? f_open(&fil, name, FA_CREATE_ALWAYS | FA_WRITE) : FR_NOT_ENOUGH_CORE;
+    if (FR_OK == t->fr) {
+        memset(rec, 'A' + t->id, 512);
+        while ((int32_t)(xTaskGetTickCount() - t->end) < 0) {
+            UINT bw;
+            t->fr = f_write(&fil, rec, 512, &bw);
+            if (FR_OK != t->fr || bw < 512) break;
+            if (!(++t->ops % 8)) f_sync(&fil);
+        }
+        f_close(&fil);
+    }
+    free(rec);
+    xTaskNotifyGive(t->parent);
+    vTaskDelete(NULL);
+}
+
+static void bench_status(void *arg) {
+    bench_task_t *t = arg;
+    TCHAR name[32];
+    FILINFO fno;
+    FATFS *fs;
+    DWORD fre;
+    while ((int32_t)(xTaskGetTickCount() - t->end) < 0) {
+        bench_name(name, sizeof name, t->drive, t->ops % t->id);
+        f_stat(name, &fno);
+        if (!(t->ops % 16)) f_getfree(t->drive, &fre, &fs);
+        ++t->ops;
+        vTaskDelay(1);
+    }
+    t->fr = FR_OK;
+    xTaskNotifyGive(t->parent);
+    vTaskDelete(NULL);
+}
+
+void ff_lock_contention_bench(const TCHAR *drive, UINT writers, UINT seconds) {
+    bench_task_t tasks[BENCH_MAX_WRITERS + 1];
+    int vol = path_volume(drive);
+    UBaseType_t prio = uxTaskPriorityGet(NULL);
+    UINT started = 0;
+
+    if (writers < 1) writers = 1;
+    if (writers > BENCH_MAX_WRITERS) writers = BENCH_MAX_WRITERS;
+    ff_lock_stats_reset(vol);
+    TickType_t end = xTaskGetTickCount() + pdMS_TO_TICKS(1000 * seconds);
+    for (UINT i = 0; i <= writers; ++i) {
+        bench_task_t *t = &tasks[i];
+        memset(t, 0, sizeof *t);
+        t->drive = drive;
+        t->id = i < writers ? i : writers;
+        t->end = end;
+        t->parent = xTaskGetCurrentTaskHandle();
+        if (pdPASS == xTaskCreate(i < writers ? bench_writer : bench_status,
+                                  "bench", 1024, t, prio, NULL))
+            ++started;
+        else
+            t->fr = FR_NOT_ENOUGH_CORE;
+    }
+    for (UINT i = 0; i < started; ++i) ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+
+    for (UINT i = 0; i < writers; ++i) {
+        TCHAR name[32];
+        printf("Writer %u: %lu KiB/s (%s)\n", i,
+               (unsigned long)(tasks[i].ops / 2 / (seconds ? seconds : 1)),
+               FRESULT_str(tasks[i].fr));
+        bench_name(name, sizeof name, drive, i);
+        f_unlink(name);
+    }
+    printf("Status task: %lu calls\n", (unsigned long)tasks[writers].ops);
+    ff_lock_stats_print(vol);
+}
@@ -20,6 +20,13 @@ specific language governing permissions and limitations under the License.
 /* storage control modules to the FatFs module with a defined API.       */
 /*-----------------------------------------------------------------------*/
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+//
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+#include "timers.h"
 //
 #include "ff.h" /* Obtains integer types */
 //
@@ -32,6 +39,398 @@ specific language governing permissions and limitations under the License.
 #define TRACE_PRINTF(fmt, args...)
 //#define TRACE_PRINTF printf  // task_printf
 
+/*-----------------------------------------------------------------------*/
+/* Per-drive state                                                       */
+/*-----------------------------------------------------------------------*/
+
+#ifndef GLUE_WRITE_COMBINE_SECTORS
+#define GLUE_WRITE_COMBINE_SECTORS 16 /*!< Per drive; 0 disables combining */
+#endif
+#ifndef GLUE_WRITE_COMBINE_TIMEOUT_MS
+#define GLUE_WRITE_COMBINE_TIMEOUT_MS 500
+#endif
+#ifndef GLUE_FLUSH_TASK_PRIORITY
+#define GLUE_FLUSH_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#endif
+#ifndef GLUE_FLUSH_TASK_STACK_SIZE
+#define GLUE_FLUSH_TASK_STACK_SIZE 1024
+#endif
+#ifndef GLUE_CACHE_SECTORS
+#define GLUE_CACHE_SECTORS 8 /*!< Per drive; 0 disables the sector cache */
+#endif
+#ifndef GLUE_READ_AHEAD_SECTORS
+#define GLUE_READ_AHEAD_SECTORS 8 /*!< Per drive; 0 disables read-ahead */
+#endif
+
+typedef struct {
+    LBA_t sector;
+    uint32_t last_used;  // For LRU replacement
+    bool valid;
+    bool dirty;
+} cache_line_t;
+
+typedef struct {
+    SemaphoreHandle_t mutex;  // Serializes everything below
+    // Write combining:
+    TimerHandle_t timer;
+    LBA_t wc_sector;          // First deferred sector
+    UINT wc_count;            // Number of deferred sectors
+    int wc_error;             // From a flush the deferred write didn't see
+    BYTE *wc_buffer;          // GLUE_WRITE_COMBINE_SECTORS * FF_MAX_SS
+    // Sector cache:
+    cache_line_t lines[GLUE_CACHE_SECTORS ? GLUE_CACHE_SECTORS : 1];
+    uint32_t use_clock;
+    BYTE *cache_buffer;       // GLUE_CACHE_SECTORS * FF_MAX_SS
+    // Read-ahead:
+    LBA_t ra_sector;          // First prefetched sector
+    UINT ra_count;            // Number of prefetched sectors
+    LBA_t ra_next;            // Sector after the last one read
+    BYTE *ra_buffer;          // GLUE_READ_AHEAD_SECTORS * FF_MAX_SS
+} glue_drive_t;
+
+static glue_drive_t drives[FF_VOLUMES];
+
+static glue_drive_t *get_drive(BYTE pdrv) {
+    if (pdrv >= FF_VOLUMES) return NULL;
+    glue_drive_t *d_p = &drives[pdrv];
+    return d_p->mutex ? d_p : NULL;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Read-ahead                                                            */
+/*-----------------------------------------------------------------------*/
+/* Reading a file back through FatFs's sector window, or in small chunks,
+   turns into one single block read per sector. When a read continues where
+   the previous one ended, a whole window of GLUE_READ_AHEAD_SECTORS is
+   fetched with one multiple block read and following reads are served from
+   it. Reads at least as big as the window go straight to the card. The
+   window is dropped when any of it is written. Sits above the write
+   combiner: every card read, refills included, goes through wc_read, which
+   first flushes any deferred sector in exactly the range read. Called with
+   the drive's mutex held. */
+
+static int wc_read(sd_card_t *p_sd, glue_drive_t *d_p, BYTE *buff,
+                   LBA_t sector, UINT count);
+
+static int ra_read(sd_card_t *p_sd, glue_drive_t *d_p, BYTE *buff,
+                   LBA_t sector, UINT count) {
+    bool sequential = sector == d_p->ra_next;
+    d_p->ra_next = sector + count;
+    while (count) {
+        // Starts in the window?
+        if (d_p->ra_count && sector >= d_p->ra_sector &&
+            sector < d_p->ra_sector + d_p->ra_count) {
+            UINT n = d_p->ra_sector + d_p->ra_count - sector;
+            if (n > count) n = count;
+            memcpy(buff, d_p->ra_buffer + (sector - d_p->ra_sector) * FF_MAX_SS,
+                   n * FF_MAX_SS);
+            buff += n * FF_MAX_SS;
+            sector += n;
+            count -= n;
+            sequential = true;  // The rest continues the window
+            continue;
+        }
+        if (!d_p->ra_buffer || !sequential || count >= GLUE_READ_AHEAD_SECTORS)
+            return wc_read(p_sd, d_p, buff, sector, count);
+        // Refill the window, without running off the end of the card
+        UINT n = GLUE_READ_AHEAD_SECTORS;
+        uint64_t sectors = sd_sectors(p_sd);
+        if (sector + n > sectors) n = sectors > sector ? sectors - sector : 0;
+        if (n < count) return wc_read(p_sd, d_p, buff, sector, count);
+        d_p->ra_count = 0;
+        int rc = wc_read(p_sd, d_p, d_p->ra_buffer, sector, n);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+        d_p->ra_sector = sector;
+        d_p->ra_count = n;
+    }
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+/* Drop the window if it overlaps a write */
+static void ra_invalidate(glue_drive_t *d_p, LBA_t sector, UINT count) {
+    if (d_p->ra_count && sector < d_p->ra_sector + d_p->ra_count &&
+        sector + count > d_p->ra_sector)
+        d_p->ra_count = 0;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Write combining                                                       */
+/*-----------------------------------------------------------------------*/
+/* FatFs tends to write a few sectors at a time, and every disk_write is a
+   full acquire/command/release cycle plus a trailing CMD13. Writes to
+   consecutive LBAs are deferred here and merged into one multiple block
+   write. Deferred data is flushed on CTRL_SYNC, before a card read of any
+   of the deferred sectors (a read-ahead refill included), when a
+   non-adjacent write comes in, and after GLUE_WRITE_COMBINE_TIMEOUT_MS. All
+   of these are called with the drive's mutex held. A flush failure is recorded in wc_error and reported by the
+   next disk_write or CTRL_SYNC, not blamed on the write that triggered the
+   flush. */
+
+static int wc_flush(sd_card_t *p_sd, glue_drive_t *d_p) {
+    if (!d_p->wc_count) return SD_BLOCK_DEVICE_ERROR_NONE;
+    int rc = p_sd->write_blocks(p_sd, d_p->wc_buffer, d_p->wc_sector,
+                                d_p->wc_count);
+    d_p->wc_count = 0;
+    xTimerStop(d_p->timer, 0);
+    return rc;
+}
+
+/* Flush, keeping the first error for the next disk_write or CTRL_SYNC */
+static void wc_flush_deferred(sd_card_t *p_sd, glue_drive_t *d_p) {
+    int rc = wc_flush(p_sd, d_p);
+    if (!d_p->wc_error) d_p->wc_error = rc;
+}
+
+static TaskHandle_t wc_flush_task_h;
+
+/* Timed flushes run here, at normal priority. The timer callback runs in
+   the timer daemon (the highest priority task) and must not block, so it
+   only sets the drive's bit in this task's notification value. */
+static void wc_flush_task(void *arg) {
+    (void)arg;
+    for (;;) {
+        uint32_t pending;
+        xTaskNotifyWait(0, UINT32_MAX, &pending, portMAX_DELAY);
+        for (BYTE pdrv = 0; pdrv < FF_VOLUMES; ++pdrv) {
+            if (!(pending & (1u << pdrv))) continue;
+            glue_drive_t *d_p = &drives[pdrv];
+            xSemaphoreTake(d_p->mutex, portMAX_DELAY);
+            wc_flush_deferred(sd_get_by_num(pdrv), d_p);
+            xSemaphoreGive(d_p->mutex);
+        }
+    }
+}
+
+static void wc_timer_callback(TimerHandle_t xTimer) {
+    BYTE pdrv = (BYTE)(uintptr_t)pvTimerGetTimerID(xTimer);
+    xTaskNotify(wc_flush_task_h, 1u << pdrv, eSetBits);
+}
+
+/* Defer a write, merging it with what is already deferred if it can be */
+static int wc_write(sd_card_t *p_sd, glue_drive_t *d_p, const BYTE *buff,
+                    LBA_t sector, UINT count) {
+    int rc = SD_BLOCK_DEVICE_ERROR_NONE;
+    ra_invalidate(d_p, sector, count);
+    // Not combining, or too big to be worth copying
+    if (!d_p->wc_buffer || count >= GLUE_WRITE_COMBINE_SECTORS) {
+        wc_flush_deferred(p_sd, d_p);
+        return p_sd->write_blocks(p_sd, buff, sector, count);
+    }
+    // Starts inside or right after the deferred run, and fits?
+    if (d_p->wc_count && sector >= d_p->wc_sector &&
+        sector <= d_p->wc_sector + d_p->wc_count &&
+        sector + count <= d_p->wc_sector + GLUE_WRITE_COMBINE_SECTORS) {
+        memcpy(d_p->wc_buffer + (sector - d_p->wc_sector) * FF_MAX_SS, buff,
+               count * FF_MAX_SS);
+        if (sector + count > d_p->wc_sector + d_p->wc_count)
+            d_p->wc_count = sector + count - d_p->wc_sector;
+        return rc;
+    }
+    wc_flush_deferred(p_sd, d_p);
+    d_p->wc_sector = sector;
+    d_p->wc_count = count;
+    memcpy(d_p->wc_buffer, buff, count * FF_MAX_SS);
+    xTimerReset(d_p->timer, 0);
+    return rc;
+}
+
+static int wc_read(sd_card_t *p_sd, glue_drive_t *d_p, BYTE *buff,
+                   LBA_t sector, UINT count) {
+    // Reading any deferred sector? Get it onto the card first.
+    if (d_p->wc_count && sector < d_p->wc_sector + d_p->wc_count &&
+        sector + count > d_p->wc_sector) {
+        int rc = wc_flush(p_sd, d_p);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+    }
+    return p_sd->read_blocks(p_sd, buff, sector, count);
+}
+
+/*-----------------------------------------------------------------------*/
+/* Sector cache                                                          */
+/*-----------------------------------------------------------------------*/
+/* While a file grows, every cluster allocation has FatFs re-read and
+   re-write FAT and directory sectors through its single sector window.
+   Those metadata sectors are kept here in a small LRU cache, written back
+   on CTRL_SYNC or eviction. Bulk file data goes straight through to the
+   write combiner: cached copies are updated on write, but data sectors are
+   never allocated a line. Sits above the read-ahead and the write
+   combiner; called with the drive's mutex held. */
+
+/* Boot sector, FSINFO, FATs, the root directory and the exFAT allocation
+   bitmap. Nothing is cached until the volume is mounted. */
+static bool is_metadata(sd_card_t *p_sd, LBA_t sector) {
+    FATFS *fs = &p_sd->fatfs;
+    if (!fs->fs_type) return false;
+    if (sector < fs->database) return true;
+    if (FS_FAT32 == fs->fs_type || FS_EXFAT == fs->fs_type) {
+        LBA_t root = fs->database + (LBA_t)fs->csize * (fs->dirbase - 2);
+        if (sector >= root && sector < root + fs->csize) return true;
+    }
+#if FF_FS_EXFAT
+    if (FS_EXFAT == fs->fs_type && sector >= fs->bitbase &&
+        sector < fs->bitbase + (fs->n_fatent + 4095) / 4096)
+        return true;
+#endif
+    return false;
+}
+
+static BYTE *line_data(glue_drive_t *d_p, cache_line_t *line_p) {
+    return d_p->cache_buffer + (line_p - d_p->lines) * FF_MAX_SS;
+}
+
+static cache_line_t *cache_find(glue_drive_t *d_p, LBA_t sector) {
+    for (size_t i = 0; i < GLUE_CACHE_SECTORS; ++i) {
+        cache_line_t *line_p = &d_p->lines[i];
+        if (line_p->valid && line_p->sector == sector) return line_p;
+    }
+    return NULL;
+}
+
+static int cache_write_back(sd_card_t *p_sd, glue_drive_t *d_p,
+                            cache_line_t *line_p) {
+    if (!line_p->dirty) return SD_BLOCK_DEVICE_ERROR_NONE;
+    line_p->dirty = false;
+    ++p_sd->cache_write_backs;
+    return wc_write(p_sd, d_p, line_data(d_p, line_p), line_p->sector, 1);
+}
+
+/* Pick a line for a new sector: a free one, or the least recently used */
+static int cache_alloc(sd_card_t *p_sd, glue_drive_t *d_p, LBA_t sector,
+                       cache_line_t **line_pp) {
+    cache_line_t *victim_p = &d_p->lines[0];
+    for (size_t i = 0; i < GLUE_CACHE_SECTORS; ++i) {
+        cache_line_t *line_p = &d_p->lines[i];
+        if (!line_p->valid) {
+            victim_p = line_p;
+            break;
+        }
+        if (line_p->last_used < victim_p->last_used) victim_p = line_p;
+    }
+    int rc = SD_BLOCK_DEVICE_ERROR_NONE;
+    if (victim_p->valid) rc = cache_write_back(p_sd, d_p, victim_p);
+    victim_p->sector = sector;
+    victim_p->valid = false;
+    victim_p->dirty = false;
+    *line_pp = victim_p;
+    return rc;
+}
+
+static void cache_touch(glue_drive_t *d_p, cache_line_t *line_p) {
+    line_p->last_used = ++d_p->use_clock;
+}
+
+static int cache_read(sd_card_t *p_sd, glue_drive_t *d_p, BYTE *buff,
+                      LBA_t sector, UINT count) {
+    if (!d_p->cache_buffer) return ra_read(p_sd, d_p, buff, sector, count);
+    if (1 == count && is_metadata(p_sd, sector)) {
+        cache_line_t *line_p = cache_find(d_p, sector);
+        if (line_p) {
+            ++p_sd->cache_hits;
+        } else {
+            ++p_sd->cache_misses;
+            int rc = cache_alloc(p_sd, d_p, sector, &line_p);
+            if (SD_BLOCK_DEVICE_ERROR_NONE == rc)
+                rc = ra_read(p_sd, d_p, line_data(d_p, line_p), sector, 1);
+            if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+            line_p->valid = true;
+        }
+        cache_touch(d_p, line_p);
+        memcpy(buff, line_data(d_p, line_p), FF_MAX_SS);
+        return SD_BLOCK_DEVICE_ERROR_NONE;
+    }
+    int rc = ra_read(p_sd, d_p, buff, sector, count);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+    // Cached copies (possibly dirty) are newer than what's on the card
+    for (size_t i = 0; i < GLUE_CACHE_SECTORS; ++i) {
+        cache_line_t *line_p = &d_p->lines[i];
+        if (line_p->valid && line_p->sector >= sector &&
+            line_p->sector < sector + count)
+            memcpy(buff + (line_p->sector - sector) * FF_MAX_SS,
+                   line_data(d_p, line_p), FF_MAX_SS);
+    }
+    return rc;
+}
+
+static int cache_write(sd_card_t *p_sd, glue_drive_t *d_p, const BYTE *buff,
+                       LBA_t sector, UINT count) {
+    if (!d_p->cache_buffer) return wc_write(p_sd, d_p, buff, sector, count);
+    if (1 == count && is_metadata(p_sd, sector)) {
+        // Write-back
+        cache_line_t *line_p = cache_find(d_p, sector);
+        if (!line_p) {
+            int rc = cache_alloc(p_sd, d_p, sector, &line_p);
+            if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+        }
+        memcpy(line_data(d_p, line_p), buff, FF_MAX_SS);
+        line_p->valid = true;
+        line_p->dirty = true;
+        cache_touch(d_p, line_p);
+        return SD_BLOCK_DEVICE_ERROR_NONE;
+    }
+    // Write-through: refresh any cached copies, which are now clean
+    for (size_t i = 0; i < GLUE_CACHE_SECTORS; ++i) {
+        cache_line_t *line_p = &d_p->lines[i];
+        if (line_p->valid && line_p->sector >= sector &&
+            line_p->sector < sector + count) {
+            memcpy(line_data(d_p, line_p),
+                   buff + (line_p->sector - sector) * FF_MAX_SS, FF_MAX_SS);
+            line_p->dirty = false;
+        }
+    }
+    return wc_write(p_sd, d_p, buff, sector, count);
+}
+
+/* Write back all dirty lines, in LBA order so adjacent FAT sectors combine */
+static int cache_sync(sd_card_t *p_sd, glue_drive_t *d_p) {
+    int rc = SD_BLOCK_DEVICE_ERROR_NONE;
+    for (;;) {
+        cache_line_t *next_p = NULL;
+        for (size_t i = 0; i < GLUE_CACHE_SECTORS; ++i) {
+            cache_line_t *line_p = &d_p->lines[i];
+            if (line_p->valid && line_p->dirty &&
+                (!next_p || line_p->sector < next_p->sector))
+                next_p = line_p;
+        }
+        if (!next_p) break;
+        int wb_rc = cache_write_back(p_sd, d_p, next_p);
+        if (!rc) rc = wb_rc;
+    }
+    return rc;
+}
+
+static void cache_invalidate(glue_drive_t *d_p) {
+    for (size_t i = 0; i < GLUE_CACHE_SECTORS; ++i)
+        d_p->lines[i].valid = false;
+}
+
+static void drive_init(BYTE pdrv) {
+    if (pdrv >= FF_VOLUMES) return;
+    glue_drive_t *d_p = &drives[pdrv];
+    if (d_p->mutex) return;
+    if (GLUE_WRITE_COMBINE_SECTORS && !wc_flush_task_h)
+        xTaskCreate(wc_flush_task, "wc_flush", GLUE_FLUSH_TASK_STACK_SIZE, NULL,
+                    GLUE_FLUSH_TASK_PRIORITY, &wc_flush_task_h);
+    if (GLUE_WRITE_COMBINE_SECTORS && wc_flush_task_h) {
+        d_p->timer = xTimerCreate("wc", pdMS_TO_TICKS(GLUE_WRITE_COMBINE_TIMEOUT_MS),
+                                  pdFALSE, (void *)(uintptr_t)pdrv, wc_timer_callback);
+        if (d_p->timer)
+            d_p->wc_buffer = malloc(GLUE_WRITE_COMBINE_SECTORS * FF_MAX_SS);
+        if (!d_p->wc_buffer)
+            DBG_PRINTF("%s: out of memory; not combining writes\r\n", __FUNCTION__);
+    }
+    if (GLUE_CACHE_SECTORS) {
+        d_p->cache_buffer = malloc(GLUE_CACHE_SECTORS * FF_MAX_SS);
+        if (!d_p->cache_buffer)
+            DBG_PRINTF("%s: out of memory; no sector cache\r\n", __FUNCTION__);
+    }
+    if (GLUE_READ_AHEAD_SECTORS) {
+        d_p->ra_buffer = malloc(GLUE_READ_AHEAD_SECTORS * FF_MAX_SS);
+        if (!d_p->ra_buffer)
+            DBG_PRINTF("%s: out of memory; no read-ahead\r\n", __FUNCTION__);
+    }
+    d_p->mutex = xSemaphoreCreateMutex();
+}
+
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
 /*-----------------------------------------------------------------------*/
@@ -59,6 +458,17 @@ DSTATUS disk_initialize(
 
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
+    drive_init(pdrv);
+    glue_drive_t *d_p = get_drive(pdrv);
+    if (d_p && (p_sd->m_Status & STA_NOINIT)) {
+        // Whatever is cached or deferred belongs to a card that is gone
+        xSemaphoreTake(d_p->mutex, portMAX_DELAY);
+        cache_invalidate(d_p);
+        d_p->ra_count = 0;
+        d_p->wc_count = 0;
+        d_p->wc_error = SD_BLOCK_DEVICE_ERROR_NONE;
+        xSemaphoreGive(d_p->mutex);
+    }
     // See http://elm-chan.org/fsw/ff/doc/dstat.html
     return p_sd->init(p_sd);  
 }
@@ -98,7 +508,11 @@ DRESULT disk_read(BYTE pdrv,  /* Physical drive nmuber to identify the drive */
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
-    int rc = p_sd->read_blocks(p_sd, buff, sector, count);
+    glue_drive_t *d_p = get_drive(pdrv);
+    if (!d_p) return sdrc2dresult(p_sd->read_blocks(p_sd, buff, sector, count));
+    xSemaphoreTake(d_p->mutex, portMAX_DELAY);
+    int rc = cache_read(p_sd, d_p, buff, sector, count);
+    xSemaphoreGive(d_p->mutex);
     return sdrc2dresult(rc);
 }
 
@@ -116,7 +530,15 @@ DRESULT disk_write(BYTE pdrv, /* Physical drive nmuber to identify the drive */
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
-    int rc = p_sd->write_blocks(p_sd, buff, sector, count);
+    glue_drive_t *d_p = get_drive(pdrv);
+    if (!d_p) return sdrc2dresult(p_sd->write_blocks(p_sd, buff, sector, count));
+    xSemaphoreTake(d_p->mutex, portMAX_DELAY);
+    // Report a failed deferred flush at the first opportunity
+    int rc = d_p->wc_error;
+    d_p->wc_error = SD_BLOCK_DEVICE_ERROR_NONE;
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc)
+        rc = cache_write(p_sd, d_p, buff, sector, count);
+    xSemaphoreGive(d_p->mutex);
     return sdrc2dresult(rc);
 }
 
@@ -141,8 +563,7 @@ DRESULT disk_ioctl(BYTE pdrv, /* Physical drive nmuber (0..) */
                                   // function to determine the size of
                                   // volume/partition to be created. It is
                                   // required when FF_USE_MKFS == 1.
-            static LBA_t n;
-            n = sd_sectors(p_sd);
+            LBA_t n = sd_sectors(p_sd);
             *(LBA_t *)buff = n;
             if (!n) return RES_ERROR;
             return RES_OK;
@@ -156,12 +577,52 @@ DRESULT disk_ioctl(BYTE pdrv, /* Physical drive nmuber (0..) */
                                 // f_mkfs function and it attempts to align data
                                 // area on the erase block boundary. It is
                                 // required when FF_USE_MKFS == 1.
-            static DWORD bs = 1;
+            // The card's allocation unit. f_mkfs needs a power of 2, and
+            // a few AU sizes (12 and 24 MiB) aren't: use the largest power
+            // of 2 that divides it, so AU boundaries are still block
+            // boundaries.
+            DWORD bs = p_sd->info.au_sectors & -p_sd->info.au_sectors;
+            if (!bs) bs = 1;
+            if (bs > 32768) bs = 32768;
             *(DWORD *)buff = bs;
             return RES_OK;
         }
-        case CTRL_SYNC:
+        case MMC_GET_CSD:     // CSD, 16 bytes
+        case MMC_GET_CID:     // CID, 16 bytes
+        case MMC_GET_OCR:     // OCR, 4 bytes
+        case MMC_GET_SDSTAT:  // SD Status, 64 bytes
+        {
+            // Served from the copies read at initialization: no bus traffic
+            const sd_card_info_t *info_p = sd_card_info(p_sd);
+            if (!info_p) return RES_NOTRDY;
+            switch (cmd) {
+                case MMC_GET_CSD:
+                    memcpy(buff, info_p->csd, sizeof info_p->csd);
+                    break;
+                case MMC_GET_CID:
+                    memcpy(buff, info_p->cid, sizeof info_p->cid);
+                    break;
+                case MMC_GET_OCR:
+                    for (int i = 0; i < 4; ++i)
+                        ((BYTE *)buff)[i] = info_p->ocr >> (24 - 8 * i);
+                    break;
+                default:
+                    memcpy(buff, info_p->sd_status, sizeof info_p->sd_status);
+            }
             return RES_OK;
+        }
+        case CTRL_SYNC: {
+            glue_drive_t *d_p = get_drive(pdrv);
+            if (!d_p) return RES_OK;
+            xSemaphoreTake(d_p->mutex, portMAX_DELAY);
+            int rc = d_p->wc_error;
+            d_p->wc_error = SD_BLOCK_DEVICE_ERROR_NONE;
+            int sync_rc = cache_sync(p_sd, d_p);
+            int flush_rc = wc_flush(p_sd, d_p);
+            xSemaphoreGive(d_p->mutex);
+            if (!rc) rc = sync_rc;
+            return sdrc2dresult(rc ? rc : flush_rc);
+        }
         default:
             return RES_PARERR;
     }
@@ -0,0 +1,146 @@
+// Asynchronous block device requests: see sd_async.h
+
+#include <string.h>
+//
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "task.h"
+//
+#include "ff.h"
+#include "diskio.h"
+//
+#include "hw_config.h"
+#include "my_debug.h"
+#include "sd_card.h"
+//
+#include "sd_async.h"
+
+#define TRACE_PRINTF(fmt, args...)
+// #define TRACE_PRINTF printf
+
+typedef struct {
+    QueueHandle_t queue;  // of sd_async_req_t *
+    TaskHandle_t task;
+    volatile bool busy;   // Servicing a request
+} sd_async_state_t;
+
+static sd_async_state_t states[FF_VOLUMES];
+
+// The physical drive number glue.c knows this card by
+static int card_pdrv(sd_card_t *sd_card_p) {
+    for (size_t i = 0; i < sd_get_num() && i < FF_VOLUMES; ++i)
+        if (sd_get_by_num(i) == sd_card_p) return i;
+    return -1;
+}
+
+static sd_async_state_t *get_state(sd_card_t *sd_card_p) {
+    int pdrv = card_pdrv(sd_card_p);
+    if (pdrv < 0 || !states[pdrv].queue) return NULL;
+    return &states[pdrv];
+}
+
+static void complete(sd_async_req_t *req_p, DRESULT status) {
+    // Once done is set the owner may reuse the request: don't touch it after
+    TaskHandle_t notify_task = req_p->notify_task;
+    req_p->status = status;
+    if (req_p->callback) req_p->callback(req_p);
+    req_p->done = true;
+    if (notify_task) xTaskNotifyGive(notify_task);
+}
+
+static void sd_async_task(void *arg) {
+    BYTE pdrv = (BYTE)(uintptr_t)arg;
+    sd_async_state_t *state_p = &states[pdrv];
+    for (;;) {
+        sd_async_req_t *req_p;
+        xQueueReceive(state_p->queue, &req_p, portMAX_DELAY);
+        state_p->busy = true;
+        TRACE_PRINTF("%s: op %d 0x%llx x %u\r\n", __FUNCTION__, req_p->op,
+                     (unsigned long long)req_p->sector, req_p->count);
+        // Through glue.c, under the drive's mutex, like any FatFs access
+        DRESULT status;
+        switch (req_p->op) {
+            case SD_ASYNC_WRITE:
+                status = disk_write(pdrv, req_p->buffer, req_p->sector,
+                                    req_p->count);
+                break;
+            case SD_ASYNC_READ:
+                status = disk_read(pdrv, req_p->buffer, req_p->sector,
+                                   req_p->count);
+                break;
+            case SD_ASYNC_SYNC:
+                status = disk_ioctl(pdrv, CTRL_SYNC, NULL);
+                break;
+            default:
+                status = RES_PARERR;
+        }
+        state_p->busy = false;
+        complete(req_p, status);
+    }
+}
+
+/* Create the request queue and worker task for a card.
+   Safe to call more than once. */
+bool sd_async_start(sd_card_t *sd_card_p, UBaseType_t priority) {
+    int pdrv = card_pdrv(sd_card_p);
+    if (pdrv < 0) return false;
+    sd_async_state_t *state_p = &states[pdrv];
+    if (state_p->queue) return true;
+    state_p->queue = xQueueCreate(SD_ASYNC_QUEUE_DEPTH, sizeof(sd_async_req_t *));
+    if (!state_p->queue) return false;
+    if (pdPASS != xTaskCreate(sd_async_task, sd_card_p->pcName,
+                              SD_ASYNC_STACK_SIZE, (void *)(uintptr_t)pdrv,
+                              priority, &state_p->task)) {
+        DBG_PRINTF("%s: couldn't create task\r\n", __FUNCTION__);
+        vQueueDelete(state_p->queue);
+        state_p->queue = NULL;
+        return false;
+    }
+    return true;
+}
+
+/* Queue a request. Returns SD_BLOCK_DEVICE_ERROR_NO_INIT if the card has no
+   worker, or SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK if the queue stayed full for
+   `wait` ticks. The request's own result is in req_p->status. */
+int sd_async_submit(sd_card_t *sd_card_p, sd_async_req_t *req_p,
+                    TickType_t wait) {
+    sd_async_state_t *state_p = get_state(sd_card_p);
+    if (!state_p) return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    if (SD_ASYNC_SYNC != req_p->op && !req_p->count)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    req_p->sd_card_p = sd_card_p;
+    req_p->status = RES_NOTRDY;
+    req_p->done = false;
+    if (pdTRUE != xQueueSend(state_p->queue, &req_p, wait)) {
+        return SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK;
+    }
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+/* Block until a request completes and return its status (RES_NOTRDY on
+   timeout). The request's notify_task must be the calling task (or NULL, in
+   which case this polls once per tick). */
+DRESULT sd_async_wait(sd_async_req_t *req_p, TickType_t timeout) {
+    TickType_t start = xTaskGetTickCount();
+    while (!req_p->done) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (portMAX_DELAY != timeout && elapsed >= timeout) return RES_NOTRDY;
+        if (req_p->notify_task)
+            // Notifications for other requests may wake us too; just re-check.
+            ulTaskNotifyTake(pdFALSE, portMAX_DELAY == timeout
+                                          ? portMAX_DELAY
+                                          : timeout - elapsed);
+        else
+            vTaskDelay(1);
+    }
+    return req_p->status;
+}
+
+/* Number of requests queued or being serviced */
+size_t sd_async_pending(sd_card_t *sd_card_p) {
+    sd_async_state_t *state_p = get_state(sd_card_p);
+    if (!state_p) return 0;
+    return uxQueueMessagesWaiting(state_p->queue) + state_p->busy;
+}
+
+/* [] END OF FILE */
@@ -1,3 +1,4 @@
+#include <string.h>
 #include "ssd1306.h"
 #include "font.h"
 
@@ -11,37 +12,64 @@ void ssd1306_init(ssd1306_t *ssd, uint8_t width, uint8_t height, bool external_v
   ssd->ram_buffer = calloc(ssd->bufsize, sizeof(uint8_t));
   ssd->ram_buffer[0] = 0x40;
   ssd->port_buffer[0] = 0x80;
+  ssd->sent_buffer = calloc(ssd->bufsize, sizeof(uint8_t));
+  ssd->tx_buffer = calloc(ssd->bufsize, sizeof(uint8_t));
+  ssd->tx_buffer[0] = 0x40;
+  ssd->dma_chan = -1;
+  ssd->busy = false;
+  ssd->tx_failed = false;
+  ssd1306_invalidate(ssd);
+}
+
+static inline void ssd1306_clear_dirty(ssd1306_t *ssd) {
+  ssd->dirty_col_min = 0xFF;
+  ssd->dirty_col_max = 0;
+  ssd->dirty_page_min = 0xFF;
+  ssd->dirty_page_max = 0;
+}
+
+static inline void ssd1306_mark_dirty(ssd1306_t *ssd, uint8_t col, uint8_t page) {
+  if (col < ssd->dirty_col_min) ssd->dirty_col_min = col;
+  if (col > ssd->dirty_col_max) ssd->dirty_col_max = col;
+  if (page < ssd->dirty_page_min) ssd->dirty_page_min = page;
+  if (page > ssd->dirty_page_max) ssd->dirty_page_max = page;
+}
+
+// O conteúdo do display é desconhecido (ex.: depois do ssd1306_config):
+// o próximo envio manda a tela inteira
+void ssd1306_invalidate(ssd1306_t *ssd) {
+  ssd->sent_valid = false;
+  ssd->dirty_col_min = 0;
+  ssd->dirty_col_max = ssd->width - 1;
+  ssd->dirty_page_min = 0;
+  ssd->dirty_page_max = ssd->pages - 1;
 }
 
 void ssd1306_config(ssd1306_t *ssd) {
-  ssd1306_command(ssd, SET_DISP | 0x00);
-  ssd1306_command(ssd, SET_MEM_ADDR);
-  ssd1306_command(ssd, 0x01);
-  ssd1306_command(ssd, SET_DISP_START_LINE | 0x00);
-  ssd1306_command(ssd, SET_SEG_REMAP | 0x01);
-  ssd1306_command(ssd, SET_MUX_RATIO);
-  ssd1306_command(ssd, HEIGHT - 1);
-  ssd1306_command(ssd, SET_COM_OUT_DIR | 0x08);
-  ssd1306_command(ssd, SET_DISP_OFFSET);
-  ssd1306_command(ssd, 0x00);
-  ssd1306_command(ssd, SET_COM_PIN_CFG);
-  ssd1306_command(ssd, 0x12);
-  ssd1306_command(ssd, SET_DISP_CLK_DIV);
-  ssd1306_command(ssd, 0x80);
-  ssd1306_command(ssd, SET_PRECHARGE);
-  ssd1306_command(ssd, 0xF1);
-  ssd1306_command(ssd, SET_VCOM_DESEL);
-  ssd1306_command(ssd, 0x30);
-  ssd1306_command(ssd, SET_CONTRAST);
-  ssd1306_command(ssd, 0xFF);
-  ssd1306_command(ssd, SET_ENTIRE_ON);
-  ssd1306_command(ssd, SET_NORM_INV);
-  ssd1306_command(ssd, SET_CHARGE_PUMP);
-  ssd1306_command(ssd, 0x14);
-  ssd1306_command(ssd, SET_DISP | 0x01);
+  const uint8_t commands[] = {
+    SET_DISP | 0x00,
+    SET_MEM_ADDR, 0x01,
+    SET_DISP_START_LINE | 0x00,
+    SET_SEG_REMAP | 0x01,
+    SET_MUX_RATIO, HEIGHT - 1,
+    SET_COM_OUT_DIR | 0x08,
+    SET_DISP_OFFSET, 0x00,
+    SET_COM_PIN_CFG, 0x12,
+    SET_DISP_CLK_DIV, 0x80,
+    SET_PRECHARGE, 0xF1,
+    SET_VCOM_DESEL, 0x30,
+    SET_CONTRAST, 0xFF,
+    SET_ENTIRE_ON,
+    SET_NORM_INV,
+    SET_CHARGE_PUMP, 0x14,
+    SET_DISP | 0x01
+  };
+  ssd1306_command_list(ssd, commands, sizeof(commands));
+  ssd1306_invalidate(ssd);
 }
 
 void ssd1306_command(ssd1306_t *ssd, uint8_t command) {
+  ssd1306_wait(ssd);
   ssd->port_buffer[1] = command;
   i2c_write_blocking(
     ssd->i2c_port,
@@ -52,66 +80,305 @@ void ssd1306_command(ssd1306_t *ssd, uint8_t command) {
   );
 }
 
+// Vários comandos numa só transação: o byte de controle 0x00 (Co = 0)
+// diz ao display que todos os bytes seguintes são comandos
+void ssd1306_command_list(ssd1306_t *ssd, const uint8_t *commands, size_t count) {
+  uint8_t buffer[SSD1306_MAX_COMMANDS + 1];
+  ssd1306_wait(ssd);
+  buffer[0] = 0x00;
+  while (count) {
+    size_t n = count < SSD1306_MAX_COMMANDS ? count : SSD1306_MAX_COMMANDS;
+    memcpy(buffer + 1, commands, n);
+    i2c_write_blocking(
+      ssd->i2c_port,
+      ssd->address,
+      buffer,
+      n + 1,
+      false
+    );
+    commands += n;
+    count -= n;
+  }
+}
+
+// Janela (colunas x páginas) que mudou desde o último envio. Um pixel
+// apagado e redesenhado marca a janela, mas não mudou: a janela é encolhida
+// para os bytes diferentes do que está no display.
+static bool ssd1306_take_window(ssd1306_t *ssd, uint8_t *c0, uint8_t *c1, uint8_t *p0, uint8_t *p1) {
+  if (ssd->dirty_col_min > ssd->dirty_col_max)
+    return false;
+  *c0 = ssd->dirty_col_min, *c1 = ssd->dirty_col_max;
+  *p0 = ssd->dirty_page_min, *p1 = ssd->dirty_page_max;
+  if (!ssd->sent_valid)
+    return true;
+
+  uint8_t nc0 = 0xFF, nc1 = 0, np0 = 0xFF, np1 = 0;
+  for (uint8_t c = *c0; c <= *c1; ++c) {
+    for (uint8_t p = *p0; p <= *p1; ++p) {
+      uint16_t index = c * ssd->pages + p + 1;
+      if (ssd->ram_buffer[index] != ssd->sent_buffer[index]) {
+        if (c < nc0) nc0 = c;
+        nc1 = c;
+        if (p < np0) np0 = p;
+        if (p > np1) np1 = p;
+      }
+    }
+  }
+  if (nc0 > nc1) {
+    ssd1306_clear_dirty(ssd);
+    return false;
+  }
+  *c0 = nc0, *c1 = nc1, *p0 = np0, *p1 = np1;
+  return true;
+}
+
+// A janela já saiu do ram_buffer: o próximo quadro pode ser desenhado
+static void ssd1306_window_sent(ssd1306_t *ssd) {
+  memcpy(ssd->sent_buffer, ssd->ram_buffer, ssd->bufsize);
+  ssd->sent_valid = true;
+  ssd1306_clear_dirty(ssd);
+}
+
+// Envia só a janela que mudou desde o último envio. Redesenhar a tela
+// inteira só para trocar um contador custa poucas dezenas de bytes no I2C,
+// e não os 1025 da tela toda.
 void ssd1306_send_data(ssd1306_t *ssd) {
-  ssd1306_command(ssd, SET_COL_ADDR);
-  ssd1306_command(ssd, 0);
-  ssd1306_command(ssd, ssd->width - 1);
-  ssd1306_command(ssd, SET_PAGE_ADDR);
-  ssd1306_command(ssd, 0);
-  ssd1306_command(ssd, ssd->pages - 1);
+  ssd1306_wait(ssd);
+  ssd->last_tx = 0;
+  uint8_t c0, c1, p0, p1;
+  if (!ssd1306_take_window(ssd, &c0, &c1, &p0, &p1))
+    return;
+
+  // Modo de endereçamento vertical: dentro da janela o display avança a
+  // página e depois a coluna, a mesma ordem do ram_buffer
+  size_t len = 1;
+  for (uint8_t c = c0; c <= c1; ++c) {
+    uint16_t index = c * ssd->pages + p0 + 1;
+    for (uint8_t p = p0; p <= p1; ++p)
+      ssd->tx_buffer[len++] = ssd->ram_buffer[index++];
+  }
+
+  const uint8_t window[] = {SET_COL_ADDR, c0, c1, SET_PAGE_ADDR, p0, p1};
+  ssd1306_command_list(ssd, window, sizeof(window));
   i2c_write_blocking(
     ssd->i2c_port,
     ssd->address,
-    ssd->ram_buffer,
-    ssd->bufsize,
+    ssd->tx_buffer,
+    len,
     false
   );
+  ssd->last_tx = len - 1;
+  ssd1306_window_sent(ssd);
+}
+
+static ssd1306_t *dma_owner[2];
+
+static void ssd1306_i2c_irq(uint idx) {
+  ssd1306_t *ssd = dma_owner[idx];
+  i2c_hw_t *hw = i2c_get_hw(ssd->i2c_port);
+  uint32_t status = hw->intr_stat;
+  if (status & I2C_IC_INTR_MASK_M_TX_ABRT_BITS) {
+    // NACK ou perda de arbitragem: o controlador descarta a FIFO
+    dma_channel_abort(ssd->dma_chan);
+    (void)hw->clr_tx_abrt;
+    ssd->tx_failed = true;
+  } else if (status & I2C_IC_INTR_MASK_M_STOP_DET_BITS) {
+    (void)hw->clr_stop_det;
+    // FIFO vazia não quer dizer que o último byte saiu: conta os STOPs (um
+    // dos comandos, um dos dados). Se a interrupção atrasou e os dois STOPs
+    // viraram um só, o controlador parado sem nada a enviar também encerra.
+    if (ssd->stops_pending && --ssd->stops_pending &&
+        (dma_channel_is_busy(ssd->dma_chan) || hw->txflr ||
+         (hw->status & I2C_IC_STATUS_MST_ACTIVITY_BITS)))
+      return;
+  } else {
+    return;
+  }
+  hw->intr_mask = 0;
+  ssd->busy = false;
+  if (ssd->on_done)
+    ssd->on_done(ssd);
+}
+
+static void ssd1306_i2c0_irq(void) { ssd1306_i2c_irq(0); }
+static void ssd1306_i2c1_irq(void) { ssd1306_i2c_irq(1); }
+
+// Habilita o envio por DMA. on_done é chamada na interrupção do I2C quando
+// a transferência termina (com sucesso ou não).
+bool ssd1306_dma_init(ssd1306_t *ssd, void (*on_done)(ssd1306_t *ssd)) {
+  uint idx = i2c_hw_index(ssd->i2c_port);
+  int chan = dma_claim_unused_channel(false);
+  if (chan < 0)
+    return false;
+  // Os 6 comandos da janela, os bytes de controle e a tela inteira
+  ssd->dma_words = calloc(8 + ssd->bufsize, sizeof(uint16_t));
+  if (!ssd->dma_words) {
+    dma_channel_unclaim(chan);
+    return false;
+  }
+  ssd->dma_chan = chan;
+  ssd->on_done = on_done;
+  dma_owner[idx] = ssd;
+
+  dma_channel_config c = dma_channel_get_default_config(chan);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+  channel_config_set_read_increment(&c, true);
+  channel_config_set_write_increment(&c, false);
+  channel_config_set_dreq(&c, i2c_get_dreq(ssd->i2c_port, true));
+  dma_channel_configure(chan, &c, &i2c_get_hw(ssd->i2c_port)->data_cmd, ssd->dma_words, 0, false);
+
+  irq_set_exclusive_handler(I2C0_IRQ + idx, idx ? ssd1306_i2c1_irq : ssd1306_i2c0_irq);
+  irq_set_enabled(I2C0_IRQ + idx, true);
+  return true;
+}
+
+// Espera a transferência em andamento. Se ela falhou, o conteúdo do display
+// é desconhecido e o próximo envio manda a tela inteira.
+void ssd1306_wait(ssd1306_t *ssd) {
+  while (ssd->busy)
+    tight_loop_contents();
+  if (ssd->tx_failed) {
+    ssd->tx_failed = false;
+    ssd1306_invalidate(ssd);
+  }
+}
+
+// Como ssd1306_send_data, mas a janela é copiada para dma_words e enviada
+// por DMA: a função volta logo e o ram_buffer pode receber o próximo quadro
+// durante o envio. Retorna true se iniciou uma transferência (on_done será
+// chamada). Sem ssd1306_dma_init o envio é bloqueante e retorna false.
+bool ssd1306_send_data_async(ssd1306_t *ssd) {
+  if (ssd->dma_chan < 0) {
+    ssd1306_send_data(ssd);
+    return false;
+  }
+  ssd1306_wait(ssd);
+  ssd->last_tx = 0;
+  uint8_t c0, c1, p0, p1;
+  if (!ssd1306_take_window(ssd, &c0, &c1, &p0, &p1))
+    return false;
+
+  // Duas transações: os comandos da janela, como em ssd1306_command_list,
+  // terminados em STOP, e os dados. O controlador gera o START seguinte
+  // sozinho.
+  uint16_t *w = ssd->dma_words;
+  *w++ = 0x00;
+  *w++ = SET_COL_ADDR;
+  *w++ = c0;
+  *w++ = c1;
+  *w++ = SET_PAGE_ADDR;
+  *w++ = p0;
+  *w++ = p1 | I2C_IC_DATA_CMD_STOP_BITS;
+  *w++ = 0x40;
+  for (uint8_t c = c0; c <= c1; ++c) {
+    uint16_t index = c * ssd->pages + p0 + 1;
+    for (uint8_t p = p0; p <= p1; ++p)
+      *w++ = ssd->ram_buffer[index++];
+  }
+  w[-1] |= I2C_IC_DATA_CMD_STOP_BITS;
+  size_t count = w - ssd->dma_words;
+  ssd->last_tx = (c1 - c0 + 1) * (p1 - p0 + 1);
+  ssd1306_window_sent(ssd);
+
+  i2c_hw_t *hw = i2c_get_hw(ssd->i2c_port);
+  // Desabilitar com o controlador ativo corta a transação em andamento
+  while (hw->status & I2C_IC_STATUS_ACTIVITY_BITS)
+    tight_loop_contents();
+  hw->enable = 0;
+  hw->tar = ssd->address;
+  hw->enable = 1;
+  (void)hw->clr_stop_det;
+  (void)hw->clr_tx_abrt;
+  ssd->stops_pending = 2;
+  ssd->busy = true;
+  // Só durante o envio por DMA: i2c_write_blocking espera o STOP_DET
+  // sem interrupção
+  hw->intr_mask = I2C_IC_INTR_MASK_M_STOP_DET_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+  dma_channel_set_read_addr(ssd->dma_chan, ssd->dma_words, false);
+  dma_channel_set_trans_count(ssd->dma_chan, count, true);
+  return true;
 }
 
 void ssd1306_pixel(ssd1306_t *ssd, uint8_t x, uint8_t y, bool value) {
   uint16_t index = (y >> 3) + (x << 3) + 1;
   uint8_t pixel = (y & 0b111);
+  uint8_t old = ssd->ram_buffer[index];
   if (value)
     ssd->ram_buffer[index] |= (1 << pixel);
   else
     ssd->ram_buffer[index] &= ~(1 << pixel);
+  if (ssd->ram_buffer[index] != old)
+    ssd1306_mark_dirty(ssd, x, y >> 3);
 }
 
-/*
-void ssd1306_fill(ssd1306_t *ssd, bool value) {
-  uint8_t byte = value ? 0xFF : 0x00;
-  for (uint8_t i = 1; i < ssd->bufsize; ++i)
-    ssd->ram_buffer[i] = byte;
-}*/
-
-void ssd1306_fill(ssd1306_t *ssd, bool value) {
-    // Itera por todas as posições do display
-    for (uint8_t y = 0; y < ssd->height; ++y) {
-        for (uint8_t x = 0; x < ssd->width; ++x) {
-            ssd1306_pixel(ssd, x, y, value);
-        }
-    }
+// Aplica os bits de mask no byte da coluna x, página page
+static inline void ssd1306_write_bits(ssd1306_t *ssd, uint8_t x, uint8_t page, uint8_t mask, uint8_t bits) {
+  uint8_t *byte = &ssd->ram_buffer[x * ssd->pages + page + 1];
+  uint8_t value = (*byte & ~mask) | (bits & mask);
+  if (value != *byte) {
+    *byte = value;
+    ssd1306_mark_dirty(ssd, x, page);
+  }
 }
 
+// Preenche o retângulo [x0, x1] x [y0, y1] (inclusive) um byte por vez:
+// cada página recebe uma máscara com as linhas do retângulo
+static void ssd1306_fill_span(ssd1306_t *ssd, int x0, int x1, int y0, int y1, bool value) {
+  if (x0 < 0) x0 = 0;
+  if (y0 < 0) y0 = 0;
+  if (x1 >= ssd->width) x1 = ssd->width - 1;
+  if (y1 >= ssd->height) y1 = ssd->height - 1;
+  if (x0 > x1 || y0 > y1)
+    return;
+  uint8_t bits = value ? 0xFF : 0x00;
+  for (int page = y0 >> 3; page <= y1 >> 3; ++page) {
+    uint8_t mask = 0xFF;
+    if (page == y0 >> 3)
+      mask &= 0xFF << (y0 & 0b111);
+    if (page == y1 >> 3)
+      mask &= 0xFF >> (7 - (y1 & 0b111));
+    for (int x = x0; x <= x1; ++x)
+      ssd1306_write_bits(ssd, x, page, mask, bits);
+  }
+}
 
+void ssd1306_fill(ssd1306_t *ssd, bool value) {
+  memset(ssd->ram_buffer + 1, value ? 0xFF : 0x00, ssd->bufsize - 1);
+  // ssd1306_send_data compara com o que já está no display
+  ssd1306_mark_dirty(ssd, 0, 0);
+  ssd1306_mark_dirty(ssd, ssd->width - 1, ssd->pages - 1);
+}
 
 void ssd1306_rect(ssd1306_t *ssd, uint8_t top, uint8_t left, uint8_t width, uint8_t height, bool value, bool fill) {
-  for (uint8_t x = left; x < left + width; ++x) {
-    ssd1306_pixel(ssd, x, top, value);
-    ssd1306_pixel(ssd, x, top + height - 1, value);
-  }
-  for (uint8_t y = top; y < top + height; ++y) {
-    ssd1306_pixel(ssd, left, y, value);
-    ssd1306_pixel(ssd, left + width - 1, y, value);
+  if (width == 0 || height == 0)
+    return;
+  int right = left + width - 1, bottom = top + height - 1;
+  if (fill) {
+    ssd1306_fill_span(ssd, left, right, top, bottom, value);
+    return;
   }
+  ssd1306_fill_span(ssd, left, right, top, top, value);
+  ssd1306_fill_span(ssd, left, right, bottom, bottom, value);
+  ssd1306_fill_span(ssd, left, left, top, bottom, value);
+  ssd1306_fill_span(ssd, right, right, top, bottom, value);
+}
 
-  if (fill) {
-    for (uint8_t x = left + 1; x < left + width - 1; ++x) {
-      for (uint8_t y = top + 1; y < top + height - 1; ++y) {
-        ssd1306_pixel(ssd, x, y, value);
-      }
-    }
+// Desloca a região [x0, x1] x [páginas p0, p1] uma coluna para a esquerda
+// e limpa a coluna x1. Com o endereçamento vertical cada coluna da região é
+// um bloco contíguo de bytes, então é uma cópia por coluna.
+void ssd1306_scroll_left(ssd1306_t *ssd, uint8_t x0, uint8_t x1, uint8_t p0, uint8_t p1) {
+  if (x1 >= ssd->width) x1 = ssd->width - 1;
+  if (p1 >= ssd->pages) p1 = ssd->pages - 1;
+  if (x0 > x1 || p0 > p1)
+    return;
+  size_t len = p1 - p0 + 1;
+  for (uint8_t x = x0; x < x1; ++x) {
+    uint8_t *column = &ssd->ram_buffer[x * ssd->pages + p0 + 1];
+    memcpy(column, column + ssd->pages, len);
   }
+  memset(&ssd->ram_buffer[x1 * ssd->pages + p0 + 1], 0, len);
+  ssd1306_mark_dirty(ssd, x0, p0);
+  ssd1306_mark_dirty(ssd, x1, p1);
 }
 
 void ssd1306_line(ssd1306_t *ssd, uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, bool value) {
@@ -144,13 +411,11 @@ void ssd1306_line(ssd1306_t *ssd, uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1
 
 
 void ssd1306_hline(ssd1306_t *ssd, uint8_t x0, uint8_t x1, uint8_t y, bool value) {
-  for (uint8_t x = x0; x <= x1; ++x)
-    ssd1306_pixel(ssd, x, y, value);
+  ssd1306_fill_span(ssd, x0, x1, y, y, value);
 }
 
 void ssd1306_vline(ssd1306_t *ssd, uint8_t x, uint8_t y0, uint8_t y1, bool value) {
-  for (uint8_t y = y0; y <= y1; ++y)
-    ssd1306_pixel(ssd, x, y, value);
+  ssd1306_fill_span(ssd, x, x, y0, y1, value);
 }
 
 // Função para desenhar um caractere
@@ -169,14 +434,17 @@ void ssd1306_draw_char(ssd1306_t *ssd, char c, uint8_t x, uint8_t y)
     index = 0; // Índice 0 corresponde ao caractere "nada" (espaço)
   }
 
-  // Desenha o caractere na tela
-  for (uint8_t i = 0; i < 8; ++i)
+  // A fonte já está em colunas de 8 linhas, como as páginas do display:
+  // com y múltiplo de 8 cada coluna é um byte; senão a coluna se divide
+  // entre duas páginas
+  uint8_t page = y >> 3, shift = y & 0b111;
+  for (uint8_t i = 0; i < 8 && x + i < ssd->width; ++i)
   {
-    uint8_t line = font[index + i]; // Acessa a linha correspondente do caractere na fonte
-    for (uint8_t j = 0; j < 8; ++j)
-    {
-      ssd1306_pixel(ssd, x + i, y + j, line & (1 << j)); // Desenha cada pixel do caractere
-    }
+    uint8_t column = font[index + i];
+    if (page < ssd->pages)
+      ssd1306_write_bits(ssd, x + i, page, 0xFF << shift, column << shift);
+    if (shift && page + 1 < ssd->pages)
+      ssd1306_write_bits(ssd, x + i, page + 1, 0xFF >> (8 - shift), column >> (8 - shift));
   }
 }
 
@@ -1,9 +1,13 @@
 #include <stdlib.h>
 #include "pico/stdlib.h"
 #include "hardware/i2c.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
 
 #define WIDTH 128
 #define HEIGHT 64
+// Comandos por transação em ssd1306_command_list
+#define SSD1306_MAX_COMMANDS 32
 
 typedef enum {
   SET_CONTRAST = 0x81,
@@ -25,23 +29,42 @@ typedef enum {
   SET_CHARGE_PUMP = 0x8D
 } ssd1306_command_t;
 
-typedef struct {
+typedef struct ssd1306 {
   uint8_t width, height, pages, address;
   i2c_inst_t *i2c_port;
   bool external_vcc;
   uint8_t *ram_buffer;
   size_t bufsize;
   uint8_t port_buffer[2];
+  // Janela alterada desde o último envio (vazia se dirty_col_min > dirty_col_max)
+  uint8_t dirty_col_min, dirty_col_max, dirty_page_min, dirty_page_max;
+  uint8_t *sent_buffer; // Cópia do que está no display
+  bool sent_valid;      // false: o display não bate com sent_buffer
+  uint8_t *tx_buffer;   // Janela a enviar, precedida do byte de controle 0x40
+  size_t last_tx;       // Bytes de dados no último ssd1306_send_data
+  // Envio por DMA (ssd1306_dma_init). Sem DMA os envios são bloqueantes.
+  int dma_chan;
+  uint16_t *dma_words;    // Comandos e janela no formato do IC_DATA_CMD
+  volatile bool busy;     // Transferência em andamento
+  volatile uint8_t stops_pending; // STOPs que faltam no envio por DMA
+  volatile bool tx_failed; // A última transferência foi abortada (NACK)
+  void (*on_done)(struct ssd1306 *ssd); // Chamada na interrupção, ao fim do envio
 } ssd1306_t;
 
 void ssd1306_init(ssd1306_t *ssd, uint8_t width, uint8_t height, bool external_vcc, uint8_t address, i2c_inst_t *i2c);
 void ssd1306_config(ssd1306_t *ssd);
 void ssd1306_command(ssd1306_t *ssd, uint8_t command);
+void ssd1306_command_list(ssd1306_t *ssd, const uint8_t *commands, size_t count);
 void ssd1306_send_data(ssd1306_t *ssd);
+void ssd1306_invalidate(ssd1306_t *ssd);
+bool ssd1306_dma_init(ssd1306_t *ssd, void (*on_done)(ssd1306_t *ssd));
+bool ssd1306_send_data_async(ssd1306_t *ssd);
+void ssd1306_wait(ssd1306_t *ssd);
 
 void ssd1306_pixel(ssd1306_t *ssd, uint8_t x, uint8_t y, bool value);
 void ssd1306_fill(ssd1306_t *ssd, bool value);
 void ssd1306_rect(ssd1306_t *ssd, uint8_t top, uint8_t left, uint8_t width, uint8_t height, bool value, bool fill);
+void ssd1306_scroll_left(ssd1306_t *ssd, uint8_t x0, uint8_t x1, uint8_t p0, uint8_t p1);
 void ssd1306_line(ssd1306_t *ssd, uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, bool value);
 void ssd1306_hline(ssd1306_t *ssd, uint8_t x0, uint8_t x1, uint8_t y, bool value);
 void ssd1306_vline(ssd1306_t *ssd, uint8_t x, uint8_t y0, uint8_t y1, bool value);
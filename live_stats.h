@@ -0,0 +1,24 @@
+#ifndef LIVE_STATS_H
+#define LIVE_STATS_H
+
+#include <stdint.h>
+#include "log_storage.h"
+
+// Contadores da tela de diagnóstico. Cada campo tem um único escritor e é
+// uma palavra de 32 bits alinhada, então a escrita é atômica no Cortex-M0+:
+// a captura e a gravação só incrementam, sem fila nem mutex, e o display lê
+// quando quiser. Taxas são calculadas no display pela diferença entre leituras.
+typedef struct
+{
+    // Escritos pela vCaptureTask
+    volatile uint32_t samples;  // Amostras capturadas desde o boot
+    volatile uint32_t buffered; // Amostras na RAM
+    volatile uint32_t dropped;  // Períodos de amostragem perdidos
+    // Escritos pela tarefa de gravação de cada cartão (log_storage.c)
+    volatile uint32_t sd_bytes[LOG_STORAGE_MAX_CARDS];        // Gravados desde o boot
+    volatile uint32_t sd_write_us_max[LOG_STORAGE_MAX_CARDS]; // Pior f_write de uma faixa
+} LiveStats;
+
+extern LiveStats live_stats;
+
+#endif
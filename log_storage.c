@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+#include "ff.h"
+#include "f_util.h"
+#include "hw_config.h"
+#include "sd_card.h"
+#include "log_storage.h"
+#include "live_stats.h"
+
+// Uma faixa do log a caminho de um cartão
+typedef struct
+{
+    uint8_t data[LOG_STRIPE_CHUNK];
+    size_t len;
+    uint8_t refs; // Cartões que ainda vão gravar esta faixa
+} LogChunk;
+
+// Pedido para a tarefa de um cartão
+typedef struct
+{
+    enum
+    {
+        LOG_REQ_WRITE, // Grava a faixa
+        LOG_REQ_SYNC,  // f_sync e avisa quem pediu
+        LOG_REQ_CLOSE  // f_close e avisa quem pediu
+    } op;
+    LogChunk *chunk;
+} LogRequest;
+
+// Estado de cada cartão: arquivo aberto e tarefa que grava nele
+typedef struct
+{
+    sd_card_t *pSD;
+    FIL file;
+    QueueHandle_t queue; // De LogRequest
+    TaskHandle_t task;
+    FRESULT fr;          // Primeiro erro desde a abertura
+    LogCardStats stats;  // Zeradas a cada abertura
+} LogCard;
+
+static LogCard cards[LOG_STORAGE_MAX_CARDS];
+static size_t n_cards;          // Cartões em uso no arquivo aberto
+static LogMode mode;
+static QueueHandle_t free_chunks; // De LogChunk *
+static LogChunk *current;       // Faixa sendo preenchida
+static uint32_t next_chunk;     // Número da próxima faixa a despachar
+static uint32_t dispatched;     // Bytes do log já entregues aos cartões
+static TaskHandle_t waiter;     // Tarefa esperando um sync ou o fechamento
+static bool is_open;
+static uint64_t open_time_us, close_time_us;
+
+// Devolve a faixa ao estoque quando o último cartão terminar com ela
+static void release(LogChunk *chunk)
+{
+    taskENTER_CRITICAL();
+    uint8_t refs = --chunk->refs;
+    taskEXIT_CRITICAL();
+    if (!refs)
+        xQueueSend(free_chunks, &chunk, portMAX_DELAY);
+}
+
+static void card_error(LogCard *card, FRESULT fr)
+{
+    card->stats.errors++;
+    card->stats.last_error = fr;
+    if (LOG_MIRROR == mode && !card->stats.demoted)
+    {
+        card->stats.demoted = true;
+        printf("AVISO: %s retirado do espelho: %s\n", card->pSD->pcName,
+               FRESULT_str(fr));
+    }
+}
+
+// No espelho basta um cartão bom; nos outros modos todos são necessários
+static bool healthy(void)
+{
+    size_t ok = 0;
+    for (size_t i = 0; i < n_cards; ++i)
+        if (FR_OK == cards[i].fr)
+            ok++;
+    return LOG_MIRROR == mode ? ok > 0 : ok == n_cards;
+}
+
+// Cada cartão tem sua tarefa: enquanto um cartão programa a flash (e libera
+// o SPI, veja sd_wait_ready_shared), o outro recebe dados pelo barramento.
+// No espelho as duas tarefas gravam a mesma faixa, intercaladas desse jeito.
+static void log_writer_task(void *arg)
+{
+    LogCard *card = arg;
+    while (true)
+    {
+        LogRequest req;
+        xQueueReceive(card->queue, &req, portMAX_DELAY);
+        if (LOG_REQ_WRITE != req.op)
+        {
+            // Um cartão com erro (talvez fora do soquete) não é sincronizado
+            FRESULT fr = FR_OK;
+            if (LOG_REQ_CLOSE == req.op)
+                fr = f_close(&card->file);
+            else if (FR_OK == card->fr)
+                fr = f_sync(&card->file);
+            if (FR_OK == card->fr && FR_OK != fr)
+            {
+                card->fr = fr;
+                card_error(card, fr);
+            }
+            xTaskNotifyGive(waiter);
+            continue;
+        }
+        LogChunk *chunk = req.chunk;
+        if (FR_OK == card->fr)
+        {
+            UINT bw;
+            uint64_t t0 = time_us_64();
+            FRESULT fr = f_write(&card->file, chunk->data, chunk->len, &bw);
+            uint32_t dt = time_us_64() - t0;
+            if (FR_OK == fr && bw < chunk->len)
+                fr = FR_DENIED; // Cartão cheio
+            card->fr = fr;
+            if (FR_OK != fr)
+                card_error(card, fr);
+            card->stats.chunks++;
+            card->stats.bytes += bw;
+            card->stats.write_us_total += dt;
+            if (dt > card->stats.write_us_max)
+                card->stats.write_us_max = dt;
+            size_t idx = card - cards;
+            live_stats.sd_bytes[idx] += bw;
+            if (dt > live_stats.sd_write_us_max[idx])
+                live_stats.sd_write_us_max[idx] = dt;
+        }
+        release(chunk);
+    }
+}
+
+// Cria as faixas e as tarefas de gravação na primeira abertura
+static bool log_storage_init(void)
+{
+    if (free_chunks)
+        return true;
+    free_chunks = xQueueCreate(LOG_STORAGE_BUFFERS, sizeof(LogChunk *));
+    if (!free_chunks)
+        return false;
+    for (size_t i = 0; i < LOG_STORAGE_BUFFERS; ++i)
+    {
+        LogChunk *chunk = pvPortMalloc(sizeof *chunk);
+        if (!chunk)
+        {
+            printf("ERRO: Sem memoria para as faixas do log\n");
+            break;
+        }
+        xQueueSend(free_chunks, &chunk, 0);
+    }
+    if (!uxQueueMessagesWaiting(free_chunks))
+        return false;
+    for (size_t i = 0; i < LOG_STORAGE_MAX_CARDS && i < sd_get_num(); ++i)
+    {
+        LogCard *card = &cards[i];
+        card->pSD = sd_get_by_num(i);
+        // Cabem todas as faixas mais o pedido de fechamento
+        card->queue = xQueueCreate(LOG_STORAGE_BUFFERS + 1, sizeof(LogRequest));
+        if (!card->queue ||
+            pdPASS != xTaskCreate(log_writer_task, card->pSD->pcName,
+                                  LOG_WRITER_STACK_SIZE, card,
+                                  LOG_WRITER_PRIORITY, &card->task))
+        {
+            printf("ERRO: Nao foi possivel criar a tarefa de %s\n",
+                   card->pSD->pcName);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Abre o log. Com dois cartões montados grava em faixas ou em espelho,
+// conforme dual_mode; senão, só no cartão 0.
+bool log_storage_open(const char *name, LogMode dual_mode)
+{
+    if (is_open || !log_storage_init())
+        return false;
+
+    n_cards = 0;
+    for (size_t i = 0; i < LOG_STORAGE_MAX_CARDS && i < sd_get_num(); ++i)
+    {
+        if (!cards[i].pSD->mounted)
+            break;
+        n_cards++;
+    }
+    if (!n_cards)
+        return false;
+    mode = n_cards > 1 ? dual_mode : LOG_SINGLE;
+
+    for (size_t i = 0; i < n_cards; ++i)
+    {
+        LogCard *card = &cards[i];
+        char path[32];
+        memset(&card->stats, 0, sizeof card->stats);
+        if (LOG_STRIPE == mode)
+            snprintf(path, sizeof path, "%s%s.%u", card->pSD->pcName, name,
+                     (unsigned)i);
+        else
+            snprintf(path, sizeof path, "%s%s", card->pSD->pcName, name);
+        card->fr = f_open(&card->file, path, FA_WRITE | FA_CREATE_ALWAYS);
+        if (FR_OK != card->fr)
+        {
+            printf("ERRO: Nao foi possivel abrir %s: %s\n", path,
+                   FRESULT_str(card->fr));
+            if (LOG_MIRROR == mode)
+            {
+                // O espelho começa só com os cartões que abriram
+                card_error(card, card->fr);
+                continue;
+            }
+            while (i--)
+                f_close(&cards[i].file);
+            return false;
+        }
+    }
+    if (!healthy())
+        return false;
+    current = NULL;
+    next_chunk = 0;
+    dispatched = 0;
+    is_open = true;
+    open_time_us = time_us_64();
+    return true;
+}
+
+// Entrega uma faixa cheia (ou a última) ao cartão da vez, ou a todos os
+// cartões ainda no espelho
+static void dispatch(LogChunk *chunk)
+{
+    LogRequest req = {.op = LOG_REQ_WRITE, .chunk = chunk};
+    dispatched += chunk->len;
+    if (LOG_MIRROR == mode)
+    {
+        LogCard *targets[LOG_STORAGE_MAX_CARDS];
+        size_t n = 0;
+        for (size_t i = 0; i < n_cards; ++i)
+            if (!cards[i].stats.demoted)
+                targets[n++] = &cards[i];
+        chunk->refs = n;
+        if (!n)
+        {
+            xQueueSend(free_chunks, &chunk, portMAX_DELAY);
+            return;
+        }
+        for (size_t i = 0; i < n; ++i)
+            xQueueSend(targets[i]->queue, &req, portMAX_DELAY);
+        return;
+    }
+    size_t idx = LOG_STRIPE == mode ? next_chunk % n_cards : 0;
+    next_chunk++;
+    chunk->refs = 1;
+    xQueueSend(cards[idx].queue, &req, portMAX_DELAY);
+}
+
+// Envia o pedido a todos os cartões e espera todos atenderem
+static void request_all(int op)
+{
+    waiter = xTaskGetCurrentTaskHandle();
+    LogRequest req = {.op = op, .chunk = NULL};
+    for (size_t i = 0; i < n_cards; ++i)
+        xQueueSend(cards[i].queue, &req, portMAX_DELAY);
+    for (size_t i = 0; i < n_cards; ++i)
+        ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+}
+
+bool log_storage_write(const void *data, size_t len)
+{
+    if (!is_open)
+        return false;
+    const uint8_t *p = data;
+    while (len)
+    {
+        if (!current)
+        {
+            xQueueReceive(free_chunks, &current, portMAX_DELAY);
+            current->len = 0;
+        }
+        size_t n = LOG_STRIPE_CHUNK - current->len;
+        if (n > len)
+            n = len;
+        memcpy(current->data + current->len, p, n);
+        current->len += n;
+        p += n;
+        len -= n;
+        if (LOG_STRIPE_CHUNK == current->len)
+        {
+            dispatch(current);
+            current = NULL;
+        }
+    }
+    // Um erro aparece com algumas faixas de atraso
+    return healthy();
+}
+
+// Entrega a faixa incompleta, se houver
+static void flush_current(void)
+{
+    if (current)
+    {
+        if (current->len)
+            dispatch(current);
+        else
+            xQueueSend(free_chunks, &current, 0);
+        current = NULL;
+    }
+}
+
+// Garante no cartão tudo o que já foi entregue. No modo faixas a faixa
+// incompleta fica na RAM (todas, menos a última, precisam ter o mesmo
+// tamanho para unir_faixas.py); nos outros modos ela também é gravada.
+// *durable: bytes do início do log que estão no cartão.
+bool log_storage_sync(uint32_t *durable)
+{
+    if (!is_open)
+        return false;
+    if (LOG_STRIPE != mode)
+        flush_current();
+    uint32_t bytes = dispatched;
+    request_all(LOG_REQ_SYNC);
+    if (!healthy())
+        return false;
+    if (durable)
+        *durable = bytes;
+    return true;
+}
+
+// Despacha a última faixa e espera todos os cartões fecharem seus arquivos
+bool log_storage_close(void)
+{
+    if (!is_open)
+        return false;
+    flush_current();
+    request_all(LOG_REQ_CLOSE);
+    close_time_us = time_us_64();
+    is_open = false;
+
+    for (size_t i = 0; i < n_cards; ++i)
+    {
+        if (FR_OK != cards[i].fr)
+            printf("ERRO ao gravar em %s: %s\n", cards[i].pSD->pcName,
+                   FRESULT_str(cards[i].fr));
+    }
+    return healthy();
+}
+
+LogMode log_storage_mode(void) { return mode; }
+size_t log_storage_cards(void) { return n_cards; }
+
+const LogCardStats *log_storage_card_stats(size_t idx)
+{
+    return idx < n_cards ? &cards[idx].stats : NULL;
+}
+
+// Vazão total do último log e o tempo de gravação de cada cartão
+void log_storage_print_stats(void)
+{
+    uint32_t bytes = 0;
+    for (size_t i = 0; i < n_cards; ++i)
+    {
+        const LogCardStats *s = &cards[i].stats;
+        bytes += s->bytes;
+        printf("%s %lu faixas, %lu bytes, f_write medio %lu us, max %lu us, "
+               "%lu erros%s\n",
+               cards[i].pSD->pcName, s->chunks, s->bytes,
+               s->chunks ? s->write_us_total / s->chunks : 0, s->write_us_max,
+               s->errors, s->demoted ? " (fora do espelho)" : "");
+    }
+    // No espelho os bytes aparecem uma vez por cartão
+    if (LOG_MIRROR == mode && n_cards)
+        bytes /= n_cards;
+    uint64_t elapsed_us = (is_open ? time_us_64() : close_time_us) - open_time_us;
+    printf("Log (%s): %lu bytes em %llu ms, %.1f kB/s\n",
+           LOG_STRIPE == mode   ? "faixas"
+           : LOG_MIRROR == mode ? "espelho"
+                                : "cartao unico",
+           bytes,
+           elapsed_us / 1000, elapsed_us ? bytes * 1000.0 / elapsed_us : 0.0);
+}
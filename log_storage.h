@@ -0,0 +1,58 @@
+#ifndef LOG_STORAGE_H
+#define LOG_STORAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Tamanho de cada faixa do log. No modo faixas (RAID-0) as faixas vão
+// alternadamente para cada cartão: a faixa 0 no cartão 0, a 1 no cartão 1,
+// a 2 no cartão 0... O script unir_faixas.py precisa usar o mesmo valor.
+// No modo espelho cada faixa vai para os dois cartões.
+#ifndef LOG_STRIPE_CHUNK
+#define LOG_STRIPE_CHUNK 2048
+#endif
+
+// Faixas em trânsito (alocadas no heap do FreeRTOS). Quando todas estão
+// na fila dos cartões, log_storage_write() espera uma ser gravada.
+#ifndef LOG_STORAGE_BUFFERS
+#define LOG_STORAGE_BUFFERS 4
+#endif
+
+#define LOG_STORAGE_MAX_CARDS 2
+
+#define LOG_WRITER_PRIORITY 3
+#define LOG_WRITER_STACK_SIZE 1024
+
+typedef enum
+{
+    LOG_SINGLE, // Só o cartão 0: o arquivo é gravado com o nome pedido
+    LOG_STRIPE, // Faixas alternadas entre os cartões: <nome>.0, <nome>.1
+    LOG_MIRROR  // O mesmo arquivo nos dois cartões. Um cartão com erro é
+                // retirado do espelho e a gravação segue no outro.
+} LogMode;
+
+// Estatísticas de um cartão, zeradas a cada log_storage_open()
+typedef struct
+{
+    uint32_t chunks;         // Faixas gravadas
+    uint32_t bytes;          // Bytes gravados
+    uint32_t write_us_total; // Tempo total dentro do f_write
+    uint32_t write_us_max;   // Pior f_write de uma faixa
+    uint32_t errors;         // f_write/f_close com erro
+    int last_error;          // FRESULT do último erro
+    bool demoted;            // Retirado do espelho depois de um erro
+} LogCardStats;
+
+// dual_mode: LOG_STRIPE ou LOG_MIRROR, usado quando há dois cartões montados
+bool log_storage_open(const char *name, LogMode dual_mode);
+bool log_storage_write(const void *data, size_t len);
+bool log_storage_sync(uint32_t *durable);
+bool log_storage_close(void);
+
+LogMode log_storage_mode(void);
+size_t log_storage_cards(void);
+const LogCardStats *log_storage_card_stats(size_t idx);
+void log_storage_print_stats(void);
+
+#endif
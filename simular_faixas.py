@@ -0,0 +1,78 @@
+import argparse
+import math
+import random
+
+# Simula a gravação do log em um cartão, em faixas (RAID-0) e em espelho em
+# dois cartões no mesmo SPI, para estimar o ganho antes de montar o hardware.
+#
+# Modelo: cada faixa ocupa o barramento pelo tempo de transferência e, depois,
+# o cartão fica ocupado programando a flash. Durante a programação o driver
+# libera o SPI (sd_wait_ready_shared), então o outro cartão pode receber dados.
+# Os tempos de ocupação seguem o que se mede em cartões comuns: ~1-3 ms por
+# escrita, com paradas ocasionais longas (coleta de lixo / troca de bloco).
+# Com o SPI liberado o driver só vê o fim da programação quando volta a
+# consultar o cartão: com mais de um cartão no barramento a ocupação é
+# arredondada para cima para um múltiplo de --poll-us (SD_SHARED_POLL_US;
+# com vTaskDelay(1) seria um tick, 1000 us).
+
+def tempo_ocupado(rng, args):
+    if rng.random() < args.prob_parada:
+        return rng.uniform(args.parada_min, args.parada_max)
+    return rng.uniform(args.ocupado_min, args.ocupado_max)
+
+def quantizar(ocupado, args):
+    passo = args.poll_us / 1000  # ms
+    return math.ceil(ocupado / passo) * passo if passo > 0 else ocupado
+
+def simular(n_cartoes, args, semente, espelho=False):
+    rng = random.Random(semente)
+    n_faixas = args.kib * 1024 // args.faixa
+    transferencia = args.faixa * 8 / (args.spi_mhz * 1e6) * 1000  # ms
+    livre_cartao = [0.0] * n_cartoes  # quando cada cartão termina de programar
+    livre_spi = 0.0                   # quando o barramento fica livre
+    pior = 0.0
+    for n in range(n_faixas):
+        # No espelho a faixa vai para todos os cartões; o cartão que terminar
+        # primeiro recebe primeiro
+        destinos = sorted(range(n_cartoes), key=lambda c: livre_cartao[c]) if espelho else [n % n_cartoes]
+        for c in destinos:
+            # Espera o cartão terminar a faixa anterior e o barramento ficar livre
+            inicio = max(livre_cartao[c], livre_spi)
+            livre_spi = inicio + transferencia
+            ocupado = tempo_ocupado(rng, args)
+            if n_cartoes > 1:
+                ocupado = quantizar(ocupado, args)
+            pior = max(pior, ocupado)
+            livre_cartao[c] = livre_spi + ocupado
+    total = max(livre_cartao)
+    return total, n_faixas * args.faixa / total, pior  # ms, bytes/ms = kB/s
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Simula o log em um cartão x faixas x espelho em dois cartões.')
+    parser.add_argument('--kib', type=int, default=1024, help='tamanho do log em KiB')
+    parser.add_argument('--faixa', type=int, default=2048, help='tamanho da faixa (LOG_STRIPE_CHUNK)')
+    parser.add_argument('--spi-mhz', type=float, default=20.8, help='clock do SPI em MHz')
+    parser.add_argument('--ocupado-min', type=float, default=1.0, help='ms ocupado por faixa (mínimo)')
+    parser.add_argument('--ocupado-max', type=float, default=3.0, help='ms ocupado por faixa (máximo)')
+    parser.add_argument('--prob-parada', type=float, default=0.02, help='probabilidade de uma parada longa')
+    parser.add_argument('--parada-min', type=float, default=20.0, help='parada longa em ms (mínimo)')
+    parser.add_argument('--parada-max', type=float, default=250.0, help='parada longa em ms (máximo)')
+    parser.add_argument('--poll-us', type=float, default=50.0, help='período de consulta com o SPI liberado, em us (0: sem arredondamento)')
+    parser.add_argument('--rodadas', type=int, default=20, help='repetições com sementes diferentes')
+    args = parser.parse_args()
+
+    modos = {'1 cartão': (1, False), 'faixas': (2, False), 'espelho': (2, True)}
+    resultados = {m: [] for m in modos}
+    for r in range(args.rodadas):
+        for i, (m, (n, espelho)) in enumerate(modos.items()):
+            resultados[m].append(simular(n, args, semente=r * 10 + i, espelho=espelho))
+
+    print(f"Log de {args.kib} KiB, faixas de {args.faixa} bytes, SPI a {args.spi_mhz} MHz, "
+          f"consulta a cada {args.poll_us:g} us, {args.rodadas} rodadas")
+    for m, res in resultados.items():
+        media = sum(v for _, v, _ in res) / len(res)
+        minimo = min(v for _, v, _ in res)
+        print(f"{m:>8}: {media:7.1f} kB/s em média, {minimo:7.1f} kB/s no pior caso")
+    base = sum(v for _, v, _ in resultados['1 cartão'])
+    for m in ('faixas', 'espelho'):
+        print(f"{m.capitalize()} / 1 cartão: {sum(v for _, v, _ in resultados[m]) / base:.2f}x")
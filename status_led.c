@@ -0,0 +1,99 @@
+#include "pico/stdlib.h"
+#include "hardware/pwm.h"
+#include "hardware/clocks.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "status_led.h"
+
+#define LED_WRAP 0xFFFF
+
+static uint led_pins[3];
+static uint irq_slice;             // Slice cuja interrupção de wrap anima o efeito
+static uint8_t color[3];
+static LedEffect effect;
+static uint32_t period_ticks, tick; // Em wraps do PWM
+static int last_brightness = -1;
+
+static void led_apply(uint8_t brightness)
+{
+    for (int i = 0; i < 3; ++i)
+        pwm_set_gpio_level(led_pins[i], (uint32_t)color[i] * brightness * LED_WRAP / (255 * 255));
+}
+
+// Interrupção de wrap (compartilhada com outros slices): calcula o brilho
+// do efeito e só reescreve os níveis quando ele muda
+static void led_wrap_irq(void)
+{
+    if (!(pwm_get_irq_status_mask() & (1u << irq_slice)))
+        return;
+    pwm_clear_irq(irq_slice);
+
+    uint32_t phase = tick++ % period_ticks, half = period_ticks / 2;
+    uint32_t brightness;
+    if (LED_BLINK == effect)
+    {
+        brightness = phase < half ? 255 : 0;
+    }
+    else
+    {
+        // Rampa triangular com correção de gama (quadrado) para o olho
+        uint32_t t = phase < half ? phase : period_ticks - phase;
+        brightness = t * 255 / half;
+        brightness = brightness * brightness / 255;
+    }
+    if ((int)brightness != last_brightness)
+    {
+        last_brightness = brightness;
+        led_apply(brightness);
+    }
+}
+
+void status_led_init(uint pin_red, uint pin_green, uint pin_blue)
+{
+    led_pins[0] = pin_red;
+    led_pins[1] = pin_green;
+    led_pins[2] = pin_blue;
+    float div = clock_get_hz(clk_sys) / (STATUS_LED_PWM_HZ * (LED_WRAP + 1.0f));
+    for (int i = 0; i < 3; ++i)
+    {
+        gpio_set_function(led_pins[i], GPIO_FUNC_PWM);
+        uint slice = pwm_gpio_to_slice_num(led_pins[i]);
+        pwm_config config = pwm_get_default_config();
+        pwm_config_set_clkdiv(&config, div);
+        pwm_config_set_wrap(&config, LED_WRAP);
+        pwm_init(slice, &config, true);
+        pwm_set_gpio_level(led_pins[i], 0);
+    }
+    irq_slice = pwm_gpio_to_slice_num(pin_red);
+    pwm_clear_irq(irq_slice);
+    irq_add_shared_handler(PWM_IRQ_WRAP, led_wrap_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(PWM_IRQ_WRAP, true);
+}
+
+void status_led_set(uint8_t red, uint8_t green, uint8_t blue, LedEffect new_effect, uint16_t period_ms)
+{
+    uint32_t ticks = (uint32_t)period_ms * STATUS_LED_PWM_HZ / 1000;
+    // O mesmo modo de novo: não reinicia a fase do efeito
+    if (red == color[0] && green == color[1] && blue == color[2] && new_effect == effect &&
+        (LED_STEADY == effect || ticks == period_ticks))
+        return;
+    uint32_t irq = save_and_disable_interrupts();
+    color[0] = red;
+    color[1] = green;
+    color[2] = blue;
+    effect = new_effect;
+    if (LED_STEADY == effect || ticks < 2)
+    {
+        pwm_set_irq_enabled(irq_slice, false);
+        led_apply(255);
+    }
+    else
+    {
+        period_ticks = ticks;
+        tick = 0;
+        last_brightness = -1;
+        pwm_clear_irq(irq_slice);
+        pwm_set_irq_enabled(irq_slice, true);
+    }
+    restore_interrupts(irq);
+}
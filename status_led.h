@@ -0,0 +1,24 @@
+#ifndef STATUS_LED_H
+#define STATUS_LED_H
+
+#include <stdint.h>
+#include "pico/types.h"
+
+// Frequência do PWM dos LEDs; a interrupção de wrap anima os efeitos
+#ifndef STATUS_LED_PWM_HZ
+#define STATUS_LED_PWM_HZ 200
+#endif
+
+typedef enum
+{
+    LED_STEADY,  // Cor fixa: interrupção desligada
+    LED_BLINK,   // Metade do período acesa, metade apagada
+    LED_BREATHE  // Brilho sobe e desce ao longo do período
+} LedEffect;
+
+void status_led_init(uint pin_red, uint pin_green, uint pin_blue);
+// Cor (0 a 255 por canal) e efeito. Só é preciso chamar quando o estado
+// muda: o PWM e a sua interrupção mantêm o efeito sem nenhuma tarefa.
+void status_led_set(uint8_t red, uint8_t green, uint8_t blue, LedEffect effect, uint16_t period_ms);
+
+#endif
@@ -0,0 +1,50 @@
+import argparse
+import os
+
+# Deve ser igual a LOG_STRIPE_CHUNK em log_storage.h
+TAMANHO_FAIXA = 2048
+
+def unir_faixas(base, saida, tamanho_faixa):
+    # As partes vêm dos dois cartões: datalog.csv.0 (cartão 0), datalog.csv.1 (cartão 1)
+    partes = []
+    i = 0
+    while os.path.exists(f"{base}.{i}"):
+        partes.append(f"{base}.{i}")
+        i += 1
+    if not partes:
+        print(f"Erro: Nenhuma parte '{base}.0' encontrada!")
+        return False
+
+    print(f"Unindo {len(partes)} parte(s) em '{saida}' (faixas de {tamanho_faixa} bytes)...")
+    arquivos = [open(p, 'rb') for p in partes]
+    total = 0
+    with open(saida, 'wb') as out:
+        # A faixa n está na parte n % len(partes); só a última pode ser menor
+        n = 0
+        while True:
+            faixa = arquivos[n % len(arquivos)].read(tamanho_faixa)
+            out.write(faixa)
+            total += len(faixa)
+            if len(faixa) < tamanho_faixa:
+                break
+            n += 1
+
+    # Sobras indicam tamanho de faixa errado ou uma parte truncada
+    ok = True
+    for p, f in zip(partes, arquivos):
+        resto = len(f.read())
+        if resto:
+            print(f"Aviso: {resto} bytes de '{p}' não foram usados. Confira o tamanho da faixa.")
+            ok = False
+        f.close()
+    print(f"{total} bytes gravados em '{saida}'.")
+    return ok
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Une o log gravado em faixas nos dois cartões SD.')
+    parser.add_argument('base', nargs='?', default='datalog.csv',
+                        help='nome do log; as partes são <base>.0, <base>.1')
+    parser.add_argument('-o', '--saida', help='arquivo de saída (padrão: o próprio nome base)')
+    parser.add_argument('--faixa', type=int, default=TAMANHO_FAIXA, help='tamanho da faixa em bytes')
+    args = parser.parse_args()
+    unir_faixas(args.base, args.saida or args.base, args.faixa)